@@ -0,0 +1,78 @@
+#ifndef ADAPTER_TRIMMER_HPP
+#define ADAPTER_TRIMMER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace adapter_trimmer {
+    const int MAX_ADAPTER_LEN = 64;
+
+    // Finds a 3' adapter in a read allowing mismatches, bitap style: one
+    // 64-bit state per number of mismatches tells for every adapter prefix
+    // whether it ends at the current base, so a read is scanned once whatever
+    // the adapter length. An adapter matches either as a whole anywhere in the
+    // read or, for at least min_overlap bases, as a prefix ending the read; a
+    // match of n bases allows n * error_rate mismatches. N in the adapter
+    // matches any base, N in the read matches nothing. Adapters longer than
+    // MAX_ADAPTER_LEN are cut to it.
+    class adapter_matcher {
+        public:
+            adapter_matcher(const std::string&, float, int);
+            // where the adapter starts in the read, the read length when absent
+            size_t find(const char*, size_t) const;
+
+        private:
+            uint64_t peq[256];                  // per base the adapter positions it matches
+            int length;
+            int max_error;
+            int min_overlap;
+            std::vector<int> allowed_error;     // by overlap length
+    };
+
+    // all adapters given for a run, a read is cut at the leftmost match
+    class adapter_set {
+        public:
+            adapter_set(float error_rate = 0.1, int min_overlap = 3) : error_rate(error_rate), min_overlap(min_overlap) {}
+            // false when the sequence holds something else than ACGTN
+            bool add_sequence(const std::string&);
+            // every record of a FASTA file, false when it cannot be read
+            bool add_fasta(const std::string&);
+            size_t find(const char*, size_t) const;
+            bool empty() const {return matchers.empty();}
+            size_t size() const {return matchers.size();}
+
+        private:
+            float error_rate;
+            int min_overlap;
+            std::vector<adapter_matcher> matchers;
+    };
+
+    struct overlap {
+        int offset;             // where read 2 reverse complemented starts on read 1, negative when before it
+        int length;             // overlapping bases, 0 when the mates do not overlap
+        size_t insert_size;
+    };
+
+    // When the insert of a pair is shorter than its reads, read 1 and the
+    // reverse complement of read 2 overlap and both mates run on into the
+    // adapter past the insert. Read 2 is first slid along read 1 and then
+    // before it, each time from the longest overlap down, and the first one
+    // of at least min_overlap bases with at most length * mismatch_rate
+    // mismatches is taken.
+    class overlap_analyzer {
+        public:
+            overlap_analyzer(int, float);
+            overlap find(const char*, size_t, const char*, size_t);
+            // sets mismatched bases of the last found overlap to the one of
+            // higher quality in both mates, returns how many were changed
+            int correct(char*, char*, size_t, char*, char*, size_t, const overlap&) const;
+
+        private:
+            int min_overlap;
+            float mismatch_rate;
+            std::string reverse;                // read 2 reverse complemented
+    };
+}
+#endif
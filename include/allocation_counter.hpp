@@ -0,0 +1,9 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+// Built with -DCOUNT_ALLOCATIONS, every operator new is counted per thread so
+// the filter can report how many heap allocations its per-read path makes.
+namespace allocation_counter {
+    unsigned long count();
+}
+#endif
@@ -0,0 +1,107 @@
+#ifndef BLOCK_COMPRESSOR_HPP
+#define BLOCK_COMPRESSOR_HPP
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/iostreams/categories.hpp>
+#include <boost/thread.hpp>
+#include <fastq_pipeline.hpp>
+
+namespace block_compressor {
+    const size_t GZIP_BLOCK_SIZE = 1 << 20;
+    const size_t BGZF_BLOCK_SIZE = 0xff00;     // leaves room for header and trailer within 64 KB
+    const size_t ZSTD_BLOCK_SIZE = 1 << 22;    // a few zstd windows, frames compress about as well as one stream
+
+    enum block_format {GZIP, BGZF, ZSTD, PLAIN};
+
+    // whether this build can write the format
+    bool is_supported(block_format);
+
+    // Fixed set of threads that run compression jobs shared by all outputs.
+    class compression_pool {
+        public:
+            compression_pool(int);
+            ~compression_pool();
+            void submit(std::function<void()>&&);
+            int size() const {return n_thread;}
+
+        private:
+            void run();
+
+            int n_thread;
+            fastq_pipeline::bounded_queue< std::function<void()> > jobs;
+            boost::thread_group threads;
+    };
+
+    struct compressed_block {
+        std::string data;
+        size_t data_size;
+        std::string output;
+        std::string error;      // why the job failed, empty when it did not
+        bool is_done;
+        boost::mutex block_mutex;
+        boost::condition_variable done;
+
+        compressed_block() : is_done(false) {}
+    };
+
+    // compress a whole buffer into one self-contained gzip member
+    void gzip_member(const char*, size_t, int, std::string&);
+    // compress a buffer of at most BGZF_BLOCK_SIZE bytes into one BGZF block
+    void bgzf_block(const char*, size_t, int, std::string&);
+    // compress a whole buffer into one self-contained zstd frame
+    void zstd_frame(const char*, size_t, int, std::string&);
+
+    // Boost.Iostreams sink that cuts the stream into blocks, compresses every
+    // block independently on the pool and writes them to the file in their
+    // original order. In GZIP format every block becomes a gzip member,
+    // concatenated members being a valid gzip stream. In BGZF format the
+    // blocks are 64 KB BGZF blocks closed by the EOF marker, and when an
+    // index file is given the offsets of every block are written to it in
+    // the .gzi layout used by bgzip. In ZSTD format every block becomes a
+    // zstd frame, concatenated frames being a valid zstd stream as well.
+    // PLAIN output is written as it comes. A block that failed to compress
+    // is thrown as std::runtime_error by the write that reaches it. The file
+    // name "-" stands for stdout, which is flushed but left open.
+    class block_sink {
+        public:
+            typedef char char_type;
+            struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
+
+            block_sink(const std::string&, compression_pool*, int, block_format = GZIP, const std::string& = "");
+            std::streamsize write(const char*, std::streamsize);
+            // compresses what is buffered and writes out every block so far,
+            // the output then holds all data written before
+            void flush();
+            void close();
+
+        private:
+            struct state {
+                std::unique_ptr<std::ostream> out;
+                compression_pool* pool;
+                int level;
+                block_format format;
+                size_t block_size;
+                size_t max_pending;
+                bool has_written;
+                bool is_closed;
+                std::string buffer;
+                std::deque< std::shared_ptr<compressed_block> > pending;
+                std::string index_filename;
+                unsigned long compressed_offset;
+                unsigned long uncompressed_offset;
+                std::vector< std::pair<unsigned long, unsigned long> > index;
+            };
+
+            void submit_buffer();
+            void write_finished(bool);
+            void write_index();
+
+            std::shared_ptr<state> impl;
+    };
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef BLOCK_DECOMPRESSOR_HPP
+#define BLOCK_DECOMPRESSOR_HPP
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <gzip_codec.hpp>
+
+namespace block_decompressor {
+    bool is_bgzf(const std::string&);
+    // compressed offsets of n block starts splitting the file into ranges of
+    // similar size, the first one is always 0 and the list ends with the file size
+    std::vector<unsigned long> split_bgzf(const std::string&, int);
+
+    // Line reader over the BGZF blocks of a file starting from a given block.
+    // Every line remembers the compressed offset of the block its first byte
+    // came from, so a caller can stop at the records owned by the next range.
+    class bgzf_range_reader {
+        public:
+            bgzf_range_reader(const std::string&, unsigned long);
+            bool getline(std::string&);
+            // skip the partial record a range usually starts in, the next four
+            // lines returned by getline() then form the first whole record
+            bool sync_record();
+            // whether the last line returned lies in the range beginning at the
+            // given block; the first line of a range is left to the range before
+            bool is_past(unsigned long) const;
+
+        private:
+            struct buffered_line {
+                std::string line;
+                unsigned long block;
+                bool is_block_start;
+            };
+
+            bool read_line(buffered_line&);
+            bool next_block();
+
+            std::ifstream in;
+            gzip_codec::block_inflater inflater;
+            unsigned long block_offset;
+            unsigned long next_offset;
+            std::string compressed;
+            std::string buffer;
+            size_t pos;
+            unsigned long current_line_block;
+            bool is_current_line_block_start;
+            std::deque<buffered_line> lookahead;
+    };
+}
+#endif
@@ -1,40 +1,180 @@
+#include <functional>
 #include <boost/filesystem.hpp>
-#include <unordered_set>
+#include <adapter_trimmer.hpp>
+#include <block_compressor.hpp>
+#include <fastq_pipeline.hpp>
+#include <read_id_index.hpp>
 
 namespace fastq_filter {
+    // quality values 0-40 and one last bin for anything higher
+    const int N_QUALITY_SYMBOL = 42;
+
+    // Symbol counts per read end and position held in one contiguous 64-byte
+    // aligned block indexed [end][pos][symbol]. Every position row is padded
+    // to whole cache lines and whole tables are merged as flat arrays.
+    class position_histogram {
+        public:
+            position_histogram(int, int, int);
+            ~position_histogram();
+            unsigned long& operator()(int end, int pos, int symbol) {return counts[((size_t)end * n_pos_ + pos) * stride + symbol];}
+            unsigned long operator()(int end, int pos, int symbol) const {return counts[((size_t)end * n_pos_ + pos) * stride + symbol];}
+            int n_end() const {return n_end_;}
+            int n_pos() const {return n_pos_;}
+            int n_symbol() const {return n_symbol_;}
+            // adds positions to every end, the counts stay where they were
+            void grow(int);
+            // the other table may have fewer positions
+            void add(const position_histogram&);
+
+        private:
+            position_histogram(const position_histogram&);
+            position_histogram& operator=(const position_histogram&);
+
+            int n_end_;
+            int n_pos_;
+            int n_symbol_;
+            int stride;
+            size_t size;
+            unsigned long* counts;
+    };
+
     struct statistic {
         unsigned long n_total;
         unsigned long n_filtered;
         unsigned long n_clean;
         std::vector< std::vector<unsigned long> > read_len_info;                      // 2i: raw, 2i+1: clean, size: 2n_end x max_read_len
         std::vector< std::vector<unsigned long> > filtered_read_info;                 // 0: high N rate, 1: low ave quality, 2: high low-quality rate, 3: adapter, 4: filtered, size: n_end x 5
-        std::vector< std::vector< std::vector<unsigned long> > > base_info;           // ACGTN, clean ACGTN, size: n_end x max_read_len x 10
-        std::vector< std::vector< std::vector<unsigned long> > > base_quality_info;   // 2i: raw, 2i+1: clean, size: 2n_end x max_read_len x 42
+        position_histogram base_info;                                               // ACGTN, clean ACGTN, size: n_end x max_read_len x 10
+        position_histogram base_quality_info;                                       // 2i: raw, 2i+1: clean, size: 2n_end x max_read_len x N_QUALITY_SYMBOL
 
+        // sized for the given read length at first, grow() makes room for
+        // longer reads as they come
         statistic(int, int);
+        void grow(int);
+        void add(const statistic&);
+    };
+
+    // Guesses the quality system in the main pass. The reader hands its
+    // batches over and the first ones are held back until the codes seen
+    // leave one system possible, n_read reads of the first fastq have been
+    // looked at or the input has ended; the guess is then settled and they
+    // are passed on to the workers unchanged, so the input is decompressed
+    // only once.
+    class quality_detector {
+        public:
+            quality_detector(fastq_pipeline::batch_scheduler*, unsigned long);
+            void push(fastq_pipeline::read_batch&&);
+            // the input has ended, settles the guess if needed
+            void close();
+            // waits until the guess is settled
+            int quality_system();
+
+            // what the guess is based on, read once it is settled
+            unsigned char min_quality() const {return min_code;}
+            unsigned char max_quality() const {return max_code;}
+            unsigned long read_count() const {return n_read;}
+            int max_read_len() const {return max_len;}
+
+        private:
+            void settle(boost::unique_lock<boost::mutex>&);
+
+            fastq_pipeline::batch_scheduler* batches;
+            unsigned long n_read_needed;
+            std::vector<fastq_pipeline::read_batch> held;
+            unsigned char min_code;
+            unsigned char max_code;
+            unsigned long n_read;
+            int max_len;
+            int guess;
+            bool is_settled;
+            boost::mutex detector_mutex;
+            boost::condition_variable settled;
+    };
+
+    // counts of one read filled by evaluate_read(), the rates are computed
+    // the same way as the filter thresholds are given
+    struct read_summary {
+        int read_len;
+        int quality_len;
+        int zero_quality;
+        int n_base_N;
+        unsigned int quality_sum;
+        int n_low_quality;
+
+        float base_N_rate() const {return n_base_N * 1.0 / read_len;}
+        float average_quality() const {return quality_sum * 1.0 / quality_len - zero_quality;}
+        float low_quality_rate() const {return n_low_quality * 1.0 / quality_len;}
+    };
+
+    // what --checkQualitySystem found in one fastq
+    struct quality_check {
+        boost::filesystem::path file;
+        unsigned char min_quality;
+        unsigned char max_quality;
+        unsigned long n_read;
+        int max_read_len;
+        int quality_system;                             // -1 when the file could not be read
+        std::string error;
     };
 
     std::string log_title();
-    int* get_read_info(const boost::filesystem::path&);
-    float get_base_N_rate(const std::string&);
-    float get_average_quality(const std::string&, const int);
-    float get_low_quality_rate(const std::string&, const int, const int);
-    int* get_base_info(const std::string&);  // 1 x (read lenth + 1)
-    int* get_base_quality_info(const std::string&, const int);
-    std::unordered_set<std::string> load_adapter(boost::filesystem::path&);
-    void trim_read(std::string&, int, int);
-    void processor(std::vector<boost::filesystem::path>&,
-            std::vector<boost::filesystem::path>&,
-            std::vector<boost::filesystem::path>&,
-            boost::filesystem::path&,
-            std::vector< std::unordered_set<std::string> >&,
+    int guess_quality_system(unsigned char, unsigned char);
+    // true once no further quality code can change the guess
+    bool is_quality_system_settled(unsigned char, unsigned char);
+    // scans up to n reads, fewer when the guess is settled before
+    quality_check check_quality_system(const boost::filesystem::path&, unsigned long);
+    // Checks the files on n threads. Every result is handed to the callback,
+    // one at a time and in the order of the files, as soon as the results of
+    // the files before it are there.
+    void check_quality_systems(const std::vector<boost::filesystem::path>&,
+            unsigned long,
+            int,
+            const std::function<void(const quality_check&)>&);
+    void evaluate_read(const fastq_pipeline::line_view&,
+            const fastq_pipeline::line_view&,
+            const int,
+            const int,
+            int*,                                       // base codes, 1 x (read length + 1)
+            int*,                                       // base qualities, 1 x (read length + 1)
+            read_summary&);
+    int* get_base_quality_info(const fastq_pipeline::line_view&, const int, int*);
+    read_id_index::fingerprint_set load_adapter(boost::filesystem::path&, int, bool);
+    bool trim_read(fastq_pipeline::line_view&, int, int, int);
+    void cut_read(fastq_pipeline::line_view&, fastq_pipeline::line_view&, size_t);
+    int trim_quality(const int*,
+            const int*,
+            const int,
+            const int,
+            const float,
+            const int,
+            read_summary&);
+    void reader(std::vector<boost::filesystem::path>&,
+            quality_detector*,
+            int,
+            int,
+            std::string*);
+    void processor(fastq_pipeline::batch_scheduler*,
+            std::vector<fastq_pipeline::record_queue*>&,
+            std::vector<fastq_pipeline::record_queue*>&,
+            std::vector<read_id_index::fingerprint_set>&,
+            const adapter_trimmer::adapter_set*,
             int*,
             float*,
             statistic*,
-            int*);
+            int);
+    // with the queues of both ends the pairs are interleaved into one output
+    void writer(std::vector<fastq_pipeline::record_queue*>,
+            boost::filesystem::path&,
+            boost::filesystem::path&,
+            block_compressor::compression_pool*,
+            int,
+            block_compressor::block_format,
+            size_t,
+            bool);
+    // drains outputs that are not written
+    void discarder(std::vector<fastq_pipeline::record_queue*>);
     void merge(std::vector<boost::filesystem::path>&,
             std::vector<boost::filesystem::path>&,
-            boost::filesystem::path&,
-            int);
-    void write_statistic(statistic stat, boost::filesystem::path&);
+            boost::filesystem::path&);
+    void write_statistic(const statistic&, boost::filesystem::path&);
 }
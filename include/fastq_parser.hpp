@@ -0,0 +1,31 @@
+#ifndef FASTQ_PARSER_HPP
+#define FASTQ_PARSER_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <fastq_pipeline.hpp>
+
+namespace fastq_parser {
+    // views of the records in a chunk whose lines all end with a newline
+    void parse_chunk(std::string&, std::vector<fastq_pipeline::fastq_record>&);
+
+    // Cuts a decompressed stream into chunks of whole records. The input is
+    // read in large blocks and newlines are searched with memchr, records are
+    // handed out as views into the chunk and only the bytes of the record
+    // running over the end of a chunk are copied to start the next one.
+    class chunk_reader {
+        public:
+            chunk_reader(std::istream&);
+            // a chunk with up to n records, false once the input is exhausted
+            bool read(size_t, fastq_pipeline::chunk_ptr&, std::vector<fastq_pipeline::fastq_record>&);
+
+        private:
+            std::istream& in;
+            bool is_eof;
+            std::string carry;
+            std::vector<size_t> line_ends;     // newline offsets found in carry
+            size_t bytes_per_record;
+    };
+}
+#endif
@@ -0,0 +1,276 @@
+#ifndef FASTQ_PIPELINE_HPP
+#define FASTQ_PIPELINE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace fastq_pipeline {
+    // one line inside a decompressed chunk, without its newline
+    struct line_view {
+        char* data;
+        size_t size;
+
+        line_view() : data(NULL), size(0) {}
+        line_view(char* data, size_t size) : data(data), size(size) {}
+        size_t length() const {return size;}
+    };
+
+    // The lines of a record point into the chunk it was read from, trimming
+    // moves the views and quality conversion rewrites the chunk in place. A
+    // record that is still intact is written back as one contiguous span.
+    struct fastq_record {
+        line_view read_id_line;
+        line_view read_line;
+        line_view plus_line;
+        line_view quality_line;
+        bool is_intact;
+    };
+
+    typedef std::shared_ptr<std::string> chunk_ptr;
+
+    struct read_batch {
+        unsigned long serial;                               // position in the input, from 0 without gaps
+        std::vector<chunk_ptr> chunks;                      // one decompressed chunk per end
+        std::vector< std::vector<fastq_record> > reads;     // one vector per end, equal sizes
+    };
+
+    // records sent to a writer together with the chunk they point into
+    struct record_batch {
+        chunk_ptr chunk;
+        std::vector<fastq_record> records;
+    };
+
+    // Blocking FIFO with a fixed capacity. Producers wait while it is full,
+    // consumers wait while it is empty. After close() consumers drain the
+    // remaining items and pop() returns false.
+    template <typename T>
+    class bounded_queue {
+        public:
+            bounded_queue(size_t capacity) : capacity(capacity), closed(false) {}
+
+            void push(T&& item) {
+                boost::unique_lock<boost::mutex> lock(queue_mutex);
+                while (items.size() >= capacity && !closed) {
+                    not_full.wait(lock);
+                }
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+            }
+
+            bool pop(T& item) {
+                boost::unique_lock<boost::mutex> lock(queue_mutex);
+                while (items.empty() && !closed) {
+                    not_empty.wait(lock);
+                }
+                if (items.empty()) {
+                    return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+            }
+
+            // non-blocking variants, false when the queue is full or empty
+            bool try_push(T&& item) {
+                boost::lock_guard<boost::mutex> lock(queue_mutex);
+                if (items.size() >= capacity || closed) {
+                    return false;
+                }
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+                return true;
+            }
+
+            bool try_pop(T& item) {
+                boost::lock_guard<boost::mutex> lock(queue_mutex);
+                if (items.empty()) {
+                    return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+            }
+
+            void close() {
+                boost::lock_guard<boost::mutex> lock(queue_mutex);
+                closed = true;
+                not_empty.notify_all();
+                not_full.notify_all();
+            }
+
+        private:
+            size_t capacity;
+            bool closed;
+            std::deque<T> items;
+            boost::mutex queue_mutex;
+            boost::condition_variable not_full;
+            boost::condition_variable not_empty;
+    };
+
+    // Hands read batches to workers. Every worker owns a deque that the
+    // producer fills round-robin, a worker takes from the front of its own
+    // deque and, once that runs dry, steals from the back of the others, so a
+    // worker held up by long reads or heavy filtering never stalls the rest.
+    // The total number of queued batches is bounded by capacity.
+    class batch_scheduler {
+        public:
+            batch_scheduler(int n_worker, size_t capacity)
+                : capacity(capacity), n_pending(0), next_worker(0), closed(false),
+                  deques(n_worker), n_taken(n_worker, 0), n_stolen(n_worker, 0) {
+                for (int i = 0; i < n_worker; i++) {
+                    deques[i] = new worker_deque();
+                }
+            }
+
+            ~batch_scheduler() {
+                for (int i = 0; i < deques.size(); i++) {
+                    delete deques[i];
+                }
+            }
+
+            void push(read_batch&& batch) {
+                int target;
+                {
+                    boost::unique_lock<boost::mutex> lock(state_mutex);
+                    while (n_pending >= capacity && !closed) {
+                        not_full.wait(lock);
+                    }
+                    target = next_worker;
+                    next_worker = (next_worker + 1) % deques.size();
+                }
+                {
+                    boost::lock_guard<boost::mutex> lock(deques[target] -> deque_mutex);
+                    deques[target] -> items.push_back(std::move(batch));
+                }
+                boost::lock_guard<boost::mutex> lock(state_mutex);
+                n_pending++;
+                not_empty.notify_all();
+            }
+
+            bool pop(int worker, read_batch& batch) {
+                while (true) {
+                    for (int i = 0; i < deques.size(); i++) {
+                        int victim = (worker + i) % deques.size();
+                        boost::unique_lock<boost::mutex> lock(deques[victim] -> deque_mutex);
+                        if (deques[victim] -> items.empty()) {
+                            continue;
+                        }
+                        if (i == 0) {
+                            batch = std::move(deques[victim] -> items.front());
+                            deques[victim] -> items.pop_front();
+                        }
+                        else {
+                            batch = std::move(deques[victim] -> items.back());
+                            deques[victim] -> items.pop_back();
+                            n_stolen[worker]++;
+                        }
+                        lock.unlock();
+
+                        n_taken[worker]++;
+                        boost::lock_guard<boost::mutex> state_lock(state_mutex);
+                        n_pending--;
+                        not_full.notify_one();
+                        return true;
+                    }
+
+                    boost::unique_lock<boost::mutex> lock(state_mutex);
+                    while (n_pending == 0 && !closed) {
+                        not_empty.wait(lock);
+                    }
+                    if (n_pending == 0 && closed) {
+                        return false;
+                    }
+                }
+            }
+
+            void close() {
+                boost::lock_guard<boost::mutex> lock(state_mutex);
+                closed = true;
+                not_empty.notify_all();
+                not_full.notify_all();
+            }
+
+            unsigned long batch_count(int worker) const {return n_taken[worker];}
+            unsigned long stolen_count(int worker) const {return n_stolen[worker];}
+
+        private:
+            struct worker_deque {
+                boost::mutex deque_mutex;
+                std::deque<read_batch> items;
+            };
+
+            size_t capacity;
+            size_t n_pending;
+            int next_worker;
+            bool closed;
+            std::vector<worker_deque*> deques;
+            std::vector<unsigned long> n_taken;
+            std::vector<unsigned long> n_stolen;
+            boost::mutex state_mutex;
+            boost::condition_variable not_full;
+            boost::condition_variable not_empty;
+    };
+
+    // Hands items out in the order of their serials, which count up from 0
+    // without gaps. A producer waits while its serial is window or more ahead
+    // of the next one due, the producer of that one never waits, so only a
+    // bounded number of items is ever held back. After close() the items
+    // received are drained in order and pop() returns false.
+    template <typename T>
+    class ordered_queue {
+        public:
+            ordered_queue(size_t window) : window(window), next_serial(0), closed(false) {}
+
+            void push(unsigned long serial, T&& item) {
+                boost::unique_lock<boost::mutex> lock(queue_mutex);
+                while (serial >= next_serial + window && !closed) {
+                    not_full.wait(lock);
+                }
+                items.emplace(serial, std::move(item));
+                if (serial == next_serial) {
+                    not_empty.notify_one();
+                }
+            }
+
+            bool pop(T& item) {
+                boost::unique_lock<boost::mutex> lock(queue_mutex);
+                while ((items.empty() || items.begin() -> first != next_serial) && !closed) {
+                    not_empty.wait(lock);
+                }
+                if (items.empty()) {
+                    return false;
+                }
+                item = std::move(items.begin() -> second);
+                next_serial = items.begin() -> first + 1;
+                items.erase(items.begin());
+                not_full.notify_all();
+                return true;
+            }
+
+            void close() {
+                boost::lock_guard<boost::mutex> lock(queue_mutex);
+                closed = true;
+                not_empty.notify_all();
+                not_full.notify_all();
+            }
+
+        private:
+            size_t window;
+            unsigned long next_serial;
+            bool closed;
+            std::map<unsigned long, T> items;
+            boost::mutex queue_mutex;
+            boost::condition_variable not_full;
+            boost::condition_variable not_empty;
+    };
+
+    typedef ordered_queue<record_batch> record_queue;
+}
+#endif
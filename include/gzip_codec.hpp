@@ -0,0 +1,65 @@
+#ifndef GZIP_CODEC_HPP
+#define GZIP_CODEC_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/stream.hpp>
+
+// All deflate and inflate work of filterfq goes through here. The library
+// doing it is chosen when configuring: libdeflate, zlib-ng or ISA-L when
+// found or requested, stock zlib otherwise. libdeflate has no streaming
+// interface, so it only takes the whole-buffer jobs (output blocks and BGZF
+// input blocks) and gzip streams are inflated by the next best library.
+namespace gzip_codec {
+    const size_t STREAM_BUFFER_SIZE = 1 << 16;
+
+    const char* inflate_backend();
+    const char* deflate_backend();
+
+    unsigned long crc32(const char*, size_t);
+    // compress a whole buffer into one self-contained gzip member
+    void deflate_gzip(const char*, size_t, int, std::string&);
+    // raw deflate into out[0, out_size), false when the result does not
+    // fit; out_size is set to the compressed size
+    bool deflate_raw(const char*, size_t, int, char*, size_t&);
+
+    // Raw inflate of independent blocks whose uncompressed size is known,
+    // keeps its decompressor between blocks.
+    class block_inflater {
+        public:
+            block_inflater();
+            ~block_inflater();
+            // true when the input inflates to exactly out_size bytes
+            bool inflate(const char*, size_t, char*, size_t);
+
+        private:
+            block_inflater(const block_inflater&);
+            block_inflater& operator=(const block_inflater&);
+
+            struct state;
+            state* impl;
+    };
+
+    // Boost.Iostreams source that reads a gzip file, concatenated members
+    // included, and returns the decompressed bytes. It can also read from a
+    // stream the caller keeps open, stdin for one.
+    class gzip_source {
+        public:
+            typedef char char_type;
+            typedef boost::iostreams::source_tag category;
+
+            gzip_source(const std::string&);
+            gzip_source(std::istream&);
+            std::streamsize read(char*, std::streamsize);
+
+        private:
+            struct state;
+            std::shared_ptr<state> impl;
+    };
+
+    // opened as gzip_istream in(gzip_source(filename), STREAM_BUFFER_SIZE)
+    typedef boost::iostreams::stream<gzip_source> gzip_istream;
+}
+#endif
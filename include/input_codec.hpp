@@ -0,0 +1,64 @@
+#ifndef INPUT_CODEC_HPP
+#define INPUT_CODEC_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/stream.hpp>
+
+// Input files are recognized by their first bytes, whatever their names: gzip
+// (BGZF being gzip with an extra field), zstd and bzip2 are decompressed and
+// anything else is taken as plain text. zstd and bzip2 need their libraries
+// found when configuring. The file name "-" stands for stdin, which is read
+// the same way except that BGZF is not told apart from gzip.
+namespace input_codec {
+    enum input_format {PLAIN, GZIP, BGZF, ZSTD, BZIP2};
+
+    input_format detect_format(const std::string&);
+    const char* format_name(input_format);
+    // whether this build can decompress the format
+    bool is_supported(input_format);
+
+    // Boost.Iostreams source returning the decompressed bytes of a file of
+    // any format above, concatenated members and frames included. It throws
+    // std::runtime_error for a format the build cannot read.
+    class input_source {
+        public:
+            typedef char char_type;
+            typedef boost::iostreams::source_tag category;
+
+            input_source(const std::string&);
+            std::streamsize read(char*, std::streamsize);
+            input_format format() const;
+
+        private:
+            struct state;
+            std::shared_ptr<state> impl;
+    };
+
+    // opened as input_istream in(input_source(filename), gzip_codec::STREAM_BUFFER_SIZE)
+    typedef boost::iostreams::stream<input_source> input_istream;
+
+    // A whole file mapped read-only, shared by the threads reading its parts.
+    class mapped_file {
+        public:
+            mapped_file(const std::string&);
+            ~mapped_file();
+            const char* data() const {return base;}
+            size_t size() const {return length;}
+
+        private:
+            mapped_file(const mapped_file&);
+            mapped_file& operator=(const mapped_file&);
+
+            const char* base;
+            size_t length;
+    };
+
+    // offsets of n record starts splitting plain fastq into ranges of similar
+    // size, the first one is always 0 and the list ends with the file size
+    std::vector<unsigned long> split_records(const mapped_file&, int);
+}
+#endif
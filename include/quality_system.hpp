@@ -1,4 +1,6 @@
 namespace quality_system {
     extern char zero_quality[5];
+    extern char min_quality[5];
+    void quality_system_convert(char*, size_t, const int, const int);
     void quality_system_convert(std::string&, const int, const int);
 }
@@ -0,0 +1,45 @@
+#ifndef READ_ID_INDEX_HPP
+#define READ_ID_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace read_id_index {
+    // 64-bit hash of a read ID, two different IDs of the same list get the
+    // same one with a chance of about n / 2^64
+    uint64_t fingerprint(const char*, size_t);
+
+    // Read ID set holding only the fingerprints of the IDs, 8 bytes per ID,
+    // in Eytzinger order so that a lookup walks down an implicit binary tree
+    // whose first levels stay in cache. It is filled, built once and then
+    // shared read-only by all workers; lookups do not allocate. A built set
+    // can be saved to a file that later runs map into memory as it is.
+    class fingerprint_set {
+        public:
+            fingerprint_set() : n_key(0) {}
+
+            void insert(const char* id, size_t size) {keys.push_back(fingerprint(id, size));}
+            void insert(uint64_t key) {keys.push_back(key);}
+            void insert(const uint64_t* first, const uint64_t* last) {keys.insert(keys.end(), first, last);}
+            // sorts out duplicates, with the given number of threads, and lays
+            // the keys out for lookups
+            void build(int = 1);
+            bool contains(const char* id, size_t size) const {return contains(fingerprint(id, size));}
+            bool contains(uint64_t) const;
+            size_t size() const {return n_key;}
+
+            // The file records the size and modification time of the list the
+            // set was built from, load() only accepts it for the same ones.
+            bool save(const std::string&, unsigned long, long) const;
+            bool load(const std::string&, unsigned long, long);
+
+        private:
+            std::vector<uint64_t> keys;             // filled before build()
+            std::shared_ptr<const uint64_t> tree;   // tree[1, n_key], owned or mapped
+            size_t n_key;
+    };
+}
+#endif
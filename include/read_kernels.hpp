@@ -0,0 +1,33 @@
+#ifndef READ_KERNELS_HPP
+#define READ_KERNELS_HPP
+
+#include <cstddef>
+
+// Per-read scanning kernels behind fastq_filter::evaluate_read(). The AVX2,
+// SSE4.2 or scalar version is picked once at startup from what the CPU
+// supports, all of them give the same results.
+namespace read_kernels {
+    // fills codes[0, n) with the base codes A 0, C 1, G 2, T 3, others 4,
+    // returns the number of 'N'
+    size_t scan_bases(const char*, size_t, int*);
+    // fills bins[0, n) with max(quality - zero, 0) and adds up the qualities
+    // as signed chars; low_quality counts the qualities below the given char
+    void scan_qualities(const char*, size_t, int, int, int*, long&, size_t&);
+    // adds a constant to every char with saturation and clamps the result
+    // to [low, high], the quality conversion between offset systems
+    void add_clamp(char*, size_t, int, int, int);
+    // dst[i] += src[i] for n counters, both 32-byte aligned
+    void add_counts(unsigned long*, const unsigned long*, size_t);
+    // the number of positions where a[0, n) and b[0, n) differ; counting
+    // gives up early and returns some count above the limit once it is
+    // exceeded
+    size_t count_mismatches(const char*, const char*, size_t, size_t);
+    // lowers min and raises max to the smallest and largest byte of s[0, n)
+    void min_max(const char*, size_t, unsigned char&, unsigned char&);
+    const char* kernel_name();
+    // switches to the AVX2, SSE4.2 or scalar version, false when the CPU
+    // lacks it; meant for comparing them, not to be called while reads are
+    // scanned
+    bool use_kernels(const char*);
+}
+#endif
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <adapter_trimmer.hpp>
+#include <read_kernels.hpp>
+
+namespace adapter_trimmer {
+    adapter_matcher::adapter_matcher(const std::string& adapter, float error_rate, int min_overlap)
+            : length(std::min((int)adapter.size(), MAX_ADAPTER_LEN)), min_overlap(std::max(min_overlap, 1)) {
+        std::fill(peq, peq + 256, 0);
+        for (int j = 0; j < length; j++) {
+            char base = toupper(adapter[j]);
+            if (base == 'N') {
+                for (const char* b = "ACGTacgt"; *b != '\0'; b++) {
+                    peq[(unsigned char)*b] |= 1ull << j;
+                }
+            }
+            else {
+                peq[(unsigned char)base] |= 1ull << j;
+                peq[(unsigned char)tolower(base)] |= 1ull << j;
+            }
+        }
+        max_error = (int)(length * error_rate);
+        allowed_error.resize(length + 1);
+        for (int n = 0; n <= length; n++) {
+            allowed_error[n] = (int)(n * error_rate);
+        }
+    }
+
+    size_t adapter_matcher::find(const char* read, size_t read_len) const {
+        // states[e] bit j: adapter[0, j] ends at the current base with at most
+        // e mismatches
+        uint64_t states[MAX_ADAPTER_LEN + 1] = {0};
+        const uint64_t whole = 1ull << (length - 1);
+        for (size_t i = 0; i < read_len; i++) {
+            uint64_t eq = peq[(unsigned char)read[i]];
+            uint64_t substituted = 0;
+            for (int e = 0; e <= max_error; e++) {
+                uint64_t extended = (states[e] << 1) | 1;
+                states[e] = (extended & eq) | substituted;
+                substituted = extended;
+            }
+            if (states[max_error] & whole) {
+                return i + 1 - length;
+            }
+        }
+        // the longest adapter prefix ending the read cuts the most
+        for (int n = std::min((size_t)length - 1, read_len); n >= min_overlap; n--) {
+            if (states[allowed_error[n]] & (1ull << (n - 1))) {
+                return read_len - n;
+            }
+        }
+        return read_len;
+    }
+
+    bool adapter_set::add_sequence(const std::string& sequence) {
+        if (sequence.empty()) {
+            return false;
+        }
+        for (std::string::const_iterator c = sequence.begin(); c != sequence.end(); c++) {
+            if (std::string("ACGTNacgtn").find(*c) == std::string::npos) {
+                return false;
+            }
+        }
+        matchers.push_back(adapter_matcher(sequence, error_rate, min_overlap));
+        return true;
+    }
+
+    bool adapter_set::add_fasta(const std::string& filename) {
+        std::ifstream in(filename);
+        if (!in) {
+            return false;
+        }
+        std::string line;
+        std::string sequence;
+        bool is_added = true;
+        while (getline(in, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            if (!line.empty() && line[0] == '>') {
+                if (!sequence.empty()) {
+                    is_added = add_sequence(sequence) && is_added;
+                }
+                sequence.clear();
+            }
+            else {
+                sequence += line;
+            }
+        }
+        if (!sequence.empty()) {
+            is_added = add_sequence(sequence) && is_added;
+        }
+        return is_added;
+    }
+
+    size_t adapter_set::find(const char* read, size_t read_len) const {
+        size_t start = read_len;
+        for (std::vector<adapter_matcher>::const_iterator m = matchers.begin(); m != matchers.end(); m++) {
+            start = std::min(start, m -> find(read, read_len));
+        }
+        return start;
+    }
+
+    static char complement(char base) {
+        switch (base) {
+            case 'A':
+                return 'T';
+            case 'C':
+                return 'G';
+            case 'G':
+                return 'C';
+            case 'T':
+                return 'A';
+            default:
+                return 'N';
+        }
+    }
+
+    overlap_analyzer::overlap_analyzer(int min_overlap, float mismatch_rate)
+            : min_overlap(std::max(min_overlap, 1)), mismatch_rate(mismatch_rate) {}
+
+    overlap overlap_analyzer::find(const char* read1, size_t read1_len, const char* read2, size_t read2_len) {
+        overlap found = {0, 0, 0};
+        reverse.resize(read2_len);
+        for (size_t j = 0; j < read2_len; j++) {
+            reverse[j] = complement(read2[read2_len - 1 - j]);
+        }
+        const char* rc = reverse.data();
+        // read 2 starting within read 1, the insert covers both reads
+        for (long offset = 0; offset + min_overlap <= (long)read1_len; offset++) {
+            size_t length = std::min(read1_len - offset, read2_len);
+            size_t limit = length * mismatch_rate;
+            if (length >= (size_t)min_overlap && read_kernels::count_mismatches(read1 + offset, rc, length, limit) <= limit) {
+                found.offset = offset;
+                found.length = length;
+                found.insert_size = offset + read2_len;
+                return found;
+            }
+        }
+        // read 2 starting before read 1, both read through into the adapter
+        for (long offset = -1; (long)read2_len + offset >= min_overlap; offset--) {
+            size_t length = std::min(read1_len, read2_len + offset);
+            size_t limit = length * mismatch_rate;
+            if (length >= (size_t)min_overlap && read_kernels::count_mismatches(read1, rc - offset, length, limit) <= limit) {
+                found.offset = offset;
+                found.length = length;
+                found.insert_size = read2_len + offset;
+                return found;
+            }
+        }
+        return found;
+    }
+
+    int overlap_analyzer::correct(char* read1, char* quality1, size_t read1_len, char* read2, char* quality2, size_t read2_len, const overlap& found) const {
+        int n_corrected = 0;
+        size_t begin1 = std::max(found.offset, 0);
+        size_t begin2 = std::max(-found.offset, 0);
+        for (size_t k = 0; k < (size_t)found.length; k++) {
+            size_t i = begin1 + k;
+            size_t j = read2_len - 1 - (begin2 + k);
+            if (i >= read1_len || j >= read2_len || read1[i] == reverse[begin2 + k]) {
+                continue;
+            }
+            if (quality1[i] > quality2[j]) {
+                read2[j] = complement(read1[i]);
+                quality2[j] = quality1[i];
+                n_corrected++;
+            }
+            else if (quality2[j] > quality1[i]) {
+                read1[i] = reverse[begin2 + k];
+                quality1[i] = quality2[j];
+                n_corrected++;
+            }
+        }
+        return n_corrected;
+    }
+}
@@ -0,0 +1,28 @@
+#include <cstdlib>
+#include <new>
+#include <allocation_counter.hpp>
+
+#ifdef COUNT_ALLOCATIONS
+static thread_local unsigned long n_allocation = 0;
+
+void* operator new(std::size_t size) {
+    n_allocation++;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace allocation_counter {
+#ifdef COUNT_ALLOCATIONS
+    unsigned long count() {return n_allocation;}
+#else
+    unsigned long count() {return 0;}
+#endif
+}
@@ -0,0 +1,297 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#include <block_compressor.hpp>
+#include <gzip_codec.hpp>
+
+namespace block_compressor {
+    compression_pool::compression_pool(int n_thread) : n_thread(n_thread), jobs(4 * n_thread) {
+        for (int i = 0; i < n_thread; i++) {
+            threads.create_thread([this]() {run();});
+        }
+    }
+
+    compression_pool::~compression_pool() {
+        jobs.close();
+        threads.join_all();
+    }
+
+    void compression_pool::submit(std::function<void()>&& job) {
+        jobs.push(std::move(job));
+    }
+
+    void compression_pool::run() {
+        std::function<void()> job;
+        while (jobs.pop(job)) {
+            job();
+        }
+    }
+
+    bool is_supported(block_format format) {
+#if !defined(HAVE_ZSTD)
+        if (format == ZSTD) {
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void gzip_member(const char* data, size_t size, int level, std::string& output) {
+        gzip_codec::deflate_gzip(data, size, level, output);
+    }
+
+    static void put_le(std::string& s, size_t pos, unsigned long value, int n_byte) {
+        for (int i = 0; i < n_byte; i++) {
+            s[pos + i] = (char)((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    void bgzf_block(const char* data, size_t size, int level, std::string& output) {
+        // 18 bytes gzip header with the BC extra field, 8 bytes CRC32 and ISIZE
+        static const char header[18] = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff', 6, 0, 'B', 'C', 2, 0, 0, 0};
+        // the EOF marker has fixed bytes that readers compare against
+        static const char eof_marker[28] = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff', 6, 0, 'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        if (size == 0) {
+            output.assign(eof_marker, sizeof(eof_marker));
+            return;
+        }
+        const size_t max_block = 65536;
+        output.resize(max_block);
+        memcpy(&output[0], header, sizeof(header));
+        size_t cdata_size = max_block - 18 - 8;
+        // data that does not shrink enough is stored uncompressed instead
+        if (!gzip_codec::deflate_raw(data, size, level, &output[18], cdata_size)) {
+            cdata_size = max_block - 18 - 8;
+            if (!gzip_codec::deflate_raw(data, size, 0, &output[18], cdata_size)) {
+                throw std::runtime_error("failed to compress BGZF block");
+            }
+        }
+        size_t block_size = 18 + cdata_size + 8;
+        output.resize(block_size);
+        put_le(output, 16, block_size - 1, 2);
+        put_le(output, 18 + cdata_size, gzip_codec::crc32(data, size), 4);
+        put_le(output, 18 + cdata_size + 4, size, 4);
+    }
+
+#if defined(HAVE_ZSTD)
+    // every pool thread keeps one zstd context, its tables are reused from
+    // one frame to the next
+    struct zstd_context {
+        ZSTD_CCtx* context;
+
+        zstd_context() : context(ZSTD_createCCtx()) {}
+        ~zstd_context() {
+            ZSTD_freeCCtx(context);
+        }
+    };
+
+    static thread_local zstd_context zstd_contexts;
+#endif
+
+    void zstd_frame(const char* data, size_t size, int level, std::string& output) {
+#if defined(HAVE_ZSTD)
+        ZSTD_CCtx* context = zstd_contexts.context;
+        if (context == NULL) {
+            throw std::runtime_error("failed to initialize zstd compressor");
+        }
+        ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+        ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+        output.resize(ZSTD_compressBound(size));
+        size_t n = ZSTD_compress2(context, &output[0], output.size(), data, size);
+        if (ZSTD_isError(n)) {
+            throw std::runtime_error("failed to compress zstd frame");
+        }
+        output.resize(n);
+#else
+        throw std::runtime_error("zstd output is not supported by this build");
+#endif
+    }
+
+    // a full disk or any other failed write ends the output with an error,
+    // it is not left to look complete
+    static void check_stream(const std::ostream& out, const char* what) {
+        if (!out) {
+            throw std::runtime_error(std::string("failed to ") + what + " the output: " + strerror(errno));
+        }
+    }
+
+    block_sink::block_sink(const std::string& filename, compression_pool* pool, int level, block_format format, const std::string& index_filename) : impl(new state()) {
+        if (filename == "-") {
+            impl -> out.reset(new boost::iostreams::stream<boost::iostreams::file_descriptor_sink>(
+                        boost::iostreams::file_descriptor_sink(STDOUT_FILENO, boost::iostreams::never_close_handle)));
+        }
+        else {
+            impl -> out.reset(new std::ofstream(filename, std::ios_base::out | std::ios_base::binary));
+        }
+        check_stream(*impl -> out, "open");
+        impl -> pool = pool;
+        impl -> level = level;
+        impl -> format = format;
+        impl -> block_size = (format == BGZF) ? BGZF_BLOCK_SIZE : ((format == ZSTD) ? ZSTD_BLOCK_SIZE : GZIP_BLOCK_SIZE);
+        impl -> index_filename = index_filename;
+        impl -> compressed_offset = 0;
+        impl -> uncompressed_offset = 0;
+        // zstd blocks are four times larger, one per thread is enough to keep the pool busy
+        impl -> max_pending = (format == ZSTD) ? pool -> size() + 2 : 2 * pool -> size() + 2;
+        impl -> has_written = false;
+        impl -> is_closed = false;
+        impl -> buffer.reserve(impl -> block_size);
+    }
+
+    std::streamsize block_sink::write(const char* s, std::streamsize n) {
+        if (impl -> format == PLAIN) {
+            impl -> out -> write(s, n);
+            check_stream(*impl -> out, "write");
+            return n;
+        }
+        std::streamsize left = n;
+        while (left > 0) {
+            size_t chunk = std::min((size_t)left, impl -> block_size - impl -> buffer.size());
+            impl -> buffer.append(s, chunk);
+            s += chunk;
+            left -= chunk;
+            if (impl -> buffer.size() == impl -> block_size) {
+                submit_buffer();
+            }
+        }
+        return n;
+    }
+
+    void block_sink::flush() {
+        if (impl -> format != PLAIN) {
+            if (!impl -> buffer.empty()) {
+                submit_buffer();
+            }
+            write_finished(true);
+        }
+        impl -> out -> flush();
+        check_stream(*impl -> out, "flush");
+    }
+
+    void block_sink::close() {
+        if (impl -> is_closed) {
+            return;
+        }
+        // an empty output still gets one (empty) member or frame to stay a valid file,
+        // BGZF is always closed by an empty block serving as the EOF marker
+        if (impl -> format != PLAIN) {
+            if (!impl -> buffer.empty() || !impl -> has_written) {
+                submit_buffer();
+            }
+            if (impl -> format == BGZF) {
+                submit_buffer();
+            }
+            write_finished(true);
+        }
+        impl -> out -> flush();
+        check_stream(*impl -> out, "flush");
+        std::ofstream* file = dynamic_cast<std::ofstream*>(impl -> out.get());
+        if (file != NULL) {
+            file -> close();
+            check_stream(*file, "close");
+        }
+        impl -> out.reset();
+        if (!impl -> index_filename.empty()) {
+            write_index();
+        }
+        impl -> is_closed = true;
+    }
+
+    void block_sink::submit_buffer() {
+        std::shared_ptr<compressed_block> block(new compressed_block());
+        block -> data.swap(impl -> buffer);
+        block -> data_size = block -> data.size();
+        impl -> buffer.reserve(impl -> block_size);
+        impl -> pending.push_back(block);
+        impl -> has_written = true;
+
+        int level = impl -> level;
+        block_format format = impl -> format;
+        impl -> pool -> submit([block, level, format]() {
+            // nothing catches an error on the pool thread, it is handed to
+            // the writer along with the block
+            try {
+                if (format == BGZF) {
+                    bgzf_block(block -> data.data(), block -> data.size(), level, block -> output);
+                }
+                else if (format == ZSTD) {
+                    zstd_frame(block -> data.data(), block -> data.size(), level, block -> output);
+                }
+                else {
+                    gzip_member(block -> data.data(), block -> data.size(), level, block -> output);
+                }
+            }
+            catch (std::exception& e) {
+                block -> error = e.what();
+            }
+            std::string().swap(block -> data);
+            boost::lock_guard<boost::mutex> lock(block -> block_mutex);
+            block -> is_done = true;
+            block -> done.notify_all();
+        });
+        write_finished(false);
+    }
+
+    // write compressed blocks from the front of the pending list, waiting for
+    // them when everything must be flushed or too many are in flight
+    void block_sink::write_finished(bool wait_all) {
+        while (!impl -> pending.empty()) {
+            std::shared_ptr<compressed_block> block = impl -> pending.front();
+            {
+                boost::unique_lock<boost::mutex> lock(block -> block_mutex);
+                if (!block -> is_done) {
+                    if (!wait_all && impl -> pending.size() <= impl -> max_pending) {
+                        return;
+                    }
+                    while (!block -> is_done) {
+                        block -> done.wait(lock);
+                    }
+                }
+            }
+            if (!block -> error.empty()) {
+                throw std::runtime_error(block -> error);
+            }
+            impl -> out -> write(block -> output.data(), block -> output.size());
+            check_stream(*impl -> out, "write");
+            impl -> compressed_offset += block -> output.size();
+            impl -> uncompressed_offset += block -> data_size;
+            // bgzip leaves the first block (0, 0) and the EOF marker out of the index
+            if (block -> data_size > 0) {
+                impl -> index.push_back(std::make_pair(impl -> compressed_offset, impl -> uncompressed_offset));
+            }
+            impl -> pending.pop_front();
+        }
+    }
+
+    // .gzi layout: number of entries followed by (compressed, uncompressed)
+    // offset pairs of every block start, all as little-endian uint64
+    void block_sink::write_index() {
+        std::vector< std::pair<unsigned long, unsigned long> >& index = impl -> index;
+        if (!index.empty()) {
+            // the last entry points past the final data block at the EOF marker
+            index.pop_back();
+        }
+        std::string entry(8, 0);
+        std::ofstream index_file(impl -> index_filename, std::ios_base::out | std::ios_base::binary);
+        put_le(entry, 0, index.size(), 8);
+        index_file.write(entry.data(), entry.size());
+        for (std::vector< std::pair<unsigned long, unsigned long> >::const_iterator i = index.begin(); i != index.end(); i++) {
+            put_le(entry, 0, i -> first, 8);
+            index_file.write(entry.data(), entry.size());
+            put_le(entry, 0, i -> second, 8);
+            index_file.write(entry.data(), entry.size());
+        }
+        index_file.close();
+        check_stream(index_file, "write the index of");
+    }
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <block_decompressor.hpp>
+
+namespace block_decompressor {
+    const size_t BGZF_HEADER_SIZE = 18;
+    const size_t BGZF_MAX_BLOCK_SIZE = 65536;
+
+    static unsigned int get_le(const unsigned char* p, int n_byte) {
+        unsigned int value = 0;
+        for (int i = n_byte - 1; i >= 0; i--) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    // gzip magic, deflate, FEXTRA set, XLEN 6 and the 'BC' subfield of length 2
+    static bool is_bgzf_header(const unsigned char* p) {
+        return p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && (p[3] & 4)
+            && p[10] == 6 && p[11] == 0 && p[12] == 'B' && p[13] == 'C' && p[14] == 2 && p[15] == 0;
+    }
+
+    bool is_bgzf(const std::string& filename) {
+        std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+        unsigned char header[BGZF_HEADER_SIZE];
+        if (!in.read((char*)header, BGZF_HEADER_SIZE)) {
+            return false;
+        }
+        return is_bgzf_header(header);
+    }
+
+    std::vector<unsigned long> split_bgzf(const std::string& filename, int n) {
+        std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+        in.seekg(0, std::ios_base::end);
+        unsigned long file_size = in.tellg();
+
+        std::vector<unsigned long> offsets(1, 0);
+        std::vector<unsigned char> window(2 * BGZF_MAX_BLOCK_SIZE + BGZF_HEADER_SIZE);
+        unsigned char next_header[BGZF_HEADER_SIZE];
+        for (int i = 1; i < n; i++) {
+            unsigned long target = file_size / n * i;
+            if (target <= offsets.back()) {
+                continue;
+            }
+            in.clear();
+            in.seekg(target);
+            in.read((char*)window.data(), window.size());
+            size_t n_read = in.gcount();
+
+            // a block header candidate is only taken when the block it
+            // announces ends exactly at another header or at the end of file
+            for (size_t p = 0; p + BGZF_HEADER_SIZE <= n_read; p++) {
+                if (!is_bgzf_header(&window[p])) {
+                    continue;
+                }
+                unsigned long candidate = target + p;
+                unsigned long following = candidate + get_le(&window[p + 16], 2) + 1;
+                bool is_valid = following == file_size;
+                if (!is_valid && following + BGZF_HEADER_SIZE <= file_size) {
+                    in.clear();
+                    in.seekg(following);
+                    in.read((char*)next_header, BGZF_HEADER_SIZE);
+                    is_valid = is_bgzf_header(next_header);
+                }
+                if (is_valid) {
+                    if (candidate < file_size) {
+                        offsets.push_back(candidate);
+                    }
+                    break;
+                }
+            }
+        }
+        offsets.push_back(file_size);
+        return offsets;
+    }
+
+    bgzf_range_reader::bgzf_range_reader(const std::string& filename, unsigned long begin)
+            : in(filename, std::ios_base::in | std::ios_base::binary), block_offset(begin), next_offset(begin), pos(0), current_line_block(begin), is_current_line_block_start(true) {
+        compressed.resize(BGZF_MAX_BLOCK_SIZE);
+        buffer.reserve(BGZF_MAX_BLOCK_SIZE);
+        in.seekg(begin);
+    }
+
+    bool bgzf_range_reader::next_block() {
+        unsigned char* header = (unsigned char*)&compressed[0];
+        // blocks are read back to back, the stream already stands at next_offset
+        while (true) {
+            if (!in.read(&compressed[0], BGZF_HEADER_SIZE)) {
+                return false;
+            }
+            if (!is_bgzf_header(header)) {
+                throw std::runtime_error("corrupted BGZF block");
+            }
+            size_t block_size = get_le(header + 16, 2) + 1;
+            if (!in.read(&compressed[BGZF_HEADER_SIZE], block_size - BGZF_HEADER_SIZE)) {
+                throw std::runtime_error("truncated BGZF block");
+            }
+            block_offset = next_offset;
+            next_offset += block_size;
+
+            size_t data_size = get_le(header + block_size - 4, 4);
+            if (data_size == 0) {
+                continue;
+            }
+            buffer.resize(data_size);
+            if (!inflater.inflate(&compressed[BGZF_HEADER_SIZE], block_size - BGZF_HEADER_SIZE - 8, &buffer[0], data_size)) {
+                throw std::runtime_error("failed to decompress BGZF block");
+            }
+            pos = 0;
+            return true;
+        }
+    }
+
+    bool bgzf_range_reader::read_line(buffered_line& l) {
+        l.line.clear();
+        if (pos == buffer.size() && !next_block()) {
+            return false;
+        }
+        l.block = block_offset;
+        l.is_block_start = pos == 0;
+        while (true) {
+            const char* begin = buffer.data() + pos;
+            const char* newline = (const char*)memchr(begin, '\n', buffer.size() - pos);
+            if (newline != NULL) {
+                l.line.append(begin, newline - begin);
+                pos = newline - buffer.data() + 1;
+                return true;
+            }
+            l.line.append(begin, buffer.size() - pos);
+            pos = buffer.size();
+            if (!next_block()) {
+                return !l.line.empty();
+            }
+        }
+    }
+
+    bool bgzf_range_reader::getline(std::string& line) {
+        if (!lookahead.empty()) {
+            line.swap(lookahead.front().line);
+            current_line_block = lookahead.front().block;
+            is_current_line_block_start = lookahead.front().is_block_start;
+            lookahead.pop_front();
+            return true;
+        }
+        buffered_line l;
+        l.line.swap(line);
+        bool is_read = read_line(l);
+        line.swap(l.line);
+        current_line_block = l.block;
+        is_current_line_block_start = l.is_block_start;
+        return is_read;
+    }
+
+    bool bgzf_range_reader::is_past(unsigned long end) const {
+        return current_line_block > end || (current_line_block == end && !is_current_line_block_start);
+    }
+
+    // A record starts at a line beginning with '@' when the line two below
+    // begins with '+' and sequence and quality have the same length. The
+    // first line of a range is skipped, it is either the tail of a line or
+    // a whole line that the previous range reads to finish its last record.
+    bool bgzf_range_reader::sync_record() {
+        buffered_line l;
+        if (!read_line(l)) {
+            return false;
+        }
+        while (true) {
+            while (lookahead.size() < 4) {
+                if (!read_line(l)) {
+                    lookahead.clear();
+                    return false;
+                }
+                lookahead.push_back(l);
+            }
+            if (lookahead[0].line.compare(0, 1, "@") == 0
+                    && lookahead[2].line.compare(0, 1, "+") == 0
+                    && lookahead[1].line.size() == lookahead[3].line.size()) {
+                return true;
+            }
+            lookahead.pop_front();
+        }
+    }
+}
@@ -18,13 +18,28 @@ namespace command_options {
         std::cout << "General options:" << std::endl;
         std::cout << std::setw(30) << std::left << "  -h, --help" << std::setw(12) << " " << std::left << "print help message" << std::endl;
         std::cout << std::setw(30) << std::left << "  -v, --version" << std::setw(12) << " " << std::left << "print current version" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -T, --tmpDir" << std::setw(12) << "[<outDir>]" << std::left << "specify the directory to store temporary files" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -t, --thread" << std::setw(12) << "[8]" << std::left << "specify the number of threads to use, maximum 8" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -T, --tmpDir" << std::setw(12) << " " << std::left << "stage the outputs in this directory and move them to outDir at the end" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -t, --thread" << std::setw(12) << "[8]" << std::left << "specify the number of threads to use" << std::endl;
         std::cout << std::endl;
         std::cout << "Input options:" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -f, --rawFastq" << std::setw(12) << " " << std::left << "raw fastq file(s) that cleaned. Required" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -f, --rawFastq" << std::setw(12) << " " << std::left << "raw fastq file(s) that cleaned, plain or compressed" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "with gzip, BGZF, zstd or bzip2, - for stdin. Required" << std::endl;
         std::cout << std::setw(30) << std::left << "  -a, --adapter" << std::setw(12) << " " << std::left << "adapter file(s) corresponding to given fastq file(s)" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -c, --checkQualitySystem" << std::setw(12) << " " << std::left << "only check quality system of give fastq(s). When not" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --adapterCache" << std::setw(12) << " " << std::left << "keep the read ID index of each adapter file as <adapter>.idx for later runs" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --adapterSeq" << std::setw(12) << " " << std::left << "adapter sequence(s) or FASTA file(s) of them, reads are" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "cut where one starts at their 3' end" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --adapterErrorRate" << std::setw(12) << "[0.1]" << std::left << "mismatches allowed per matched adapter base" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --adapterMinOverlap" << std::setw(12) << "[3]" << std::left << "minimum adapter bases matching at the end of a read" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --overlapTrim" << std::setw(12) << " " << std::left << "cut paired reads to their insert where read 1 overlaps" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "read 2 reverse complemented" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --overlapCorrect" << std::setw(12) << " " << std::left << "also set mismatched bases in the overlap to the one of" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "higher quality" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --overlapMinLen" << std::setw(12) << "[30]" << std::left << "minimum overlap of the mates" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --overlapMismatchRate" << std::setw(12) << "[0.1]" << std::left << "mismatches allowed per overlapping base" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -c, --checkQualitySystem" << std::setw(12) << " " << std::left << "only check quality system of give fastq(s), -t of them" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "at a time. One tab-separated line per file goes to stdout:" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "file, system (-1 on error), name or error, min and max" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "code, reads checked, max read length. When not" << std::endl;
         std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "specified, filterfq will automatically check quality" << std::endl;
         std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "system before filtering" << std::endl;
         std::cout << std::setw(30) << std::left << "  -s, --rawQualitySystem" << std::setw(12) << " " << std::left << "specify quality system of given fastq(s)" << std::endl;
@@ -58,13 +73,33 @@ namespace command_options {
         std::cout << std::setw(30) << " " << std::setw(12) << " " << "    " << std::setw(11) << std::left << " " << "  first '+' is for 5' end of fastq_1"<< std::endl;
         std::cout << std::setw(30) << " " << std::setw(12) << " " << "    " << std::setw(11) << std::left << " " << "  read and first '-' is for 3' end of"<< std::endl;
         std::cout << std::setw(30) << " " << std::setw(12) << " " << "    " << std::setw(11) << std::left << " " << "  fastq_1 read"<< std::endl;
+        std::cout << std::setw(30) << std::left << "  --slidingWindow" << std::setw(12) << "[0]" << std::left << "size of the window moved along a read, which is cut" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "from the first window whose average quality is" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "below windowQuality, 0 to disable" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --windowQuality" << std::setw(12) << "[20]" << std::left << "minimum average quality of a sliding window" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --tailQuality" << std::setw(12) << "[0]" << std::left << "quality threshold of BWA-style 3' trimming, 0 to" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "disable" << std::endl;
         std::cout << std::setw(30) << std::left << "  -l, --minReadLen" << std::setw(12) << "[90]" << std::left << "minimum read length in ouput fastq(s), for trimming" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -L, --maxReadLen" << std::setw(12) << "[100]" << std::left << "maximum read length in input fastq(s), for statistical use" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -L, --maxReadLen" << std::setw(12) << "[100]" << std::left << "expected maximum read length in input fastq(s), the" << std::endl;
+        std::cout << std::setw(30) << " " << std::setw(12) << " " << std::left << "statistics grow past it as needed" << std::endl;
         std::cout << std::endl;
         std::cout << "Output options:" << std::endl;
         std::cout << std::setw(30) << std::left << "  -S, --cleanQualitySystem" << std::setw(12) << "[4]" << std::left << "specify quality system of cleaned fastq(s)" << std::endl;
         std::cout << std::setw(30) << std::left << "  -o, --outBasename" << std::setw(12) << " " << std::left << "basename for output files. Required when filtering" << std::endl;
-        std::cout << std::setw(30) << std::left << "  -O, --outDir" << std::setw(12) << " " << std::left << "output directory. Required when filtering" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "- writes the cleaned reads to stdout, pairs interleaved," << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "and discards the dropped ones" << std::endl;
+        std::cout << std::setw(30) << std::left << "  -O, --outDir" << std::setw(12) << " " << std::left << "output directory. Required when filtering to files" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --outFormat" << std::setw(12) << "[gzip]" << std::left << "format of output fastq(s): gzip, bgzf, zstd or plain," << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "named .fastq.gz, .fastq.zst or .fastq" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --compressLevel" << std::setw(12) << "[6]" << std::left << "compression level of output fastq(s), 0-9 for gzip" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "and 1-19 for zstd (3 when not given)" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --bgzf" << std::setw(12) << " " << std::left << "write output fastq(s) in BGZF with a .gzi block index," << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "the same as --outFormat bgzf" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --compressThreads" << std::setw(12) << "[<thread>]" << std::left << "the number of threads compressing output fastq(s)" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --writeBufferSize" << std::setw(12) << "[4096]" << std::left << "size in KB of the buffer output fastq(s) are assembled in" << std::endl;
+        std::cout << std::setw(30) << std::left << "  --lowLatency" << std::setw(12) << " " << std::left << "pass reads on in batches of 1000 and flush the output" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "after each, written plain to stdout and at level 1 to" << std::endl;
+        std::cout << std::setw(30) << std::left << "  " << std::setw(12) << " " << std::left << "files unless --outFormat or --compressLevel is given" << std::endl;
         std::cout << std::endl;
     }
 
@@ -1,543 +1,1191 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
 #include <iostream>
 #include <fstream>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
 #include <numeric>
-#include <unordered_set>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/algorithm/minmax_element.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
+#include <allocation_counter.hpp>
+#include <block_compressor.hpp>
+#include <block_decompressor.hpp>
+#include <fastq_filter.hpp>
+#include <fastq_parser.hpp>
+#include <fastq_pipeline.hpp>
+#include <gzip_codec.hpp>
+#include <input_codec.hpp>
 #include <quality_system.hpp>
+#include <read_id_index.hpp>
+#include <read_kernels.hpp>
 
 boost::mutex mutex;
 
 namespace fastq_filter {
+    const unsigned long BGZF_SEGMENT_SIZE = 16 << 20;
+    const unsigned long PLAIN_SEGMENT_SIZE = 64 << 20;
+    const size_t SEGMENT_BATCHES = 16;             // read ahead by every segment thread
+    const size_t ADAPTER_CHUNK_SIZE = 1 << 22;
 
-    struct statistic {
-        unsigned long n_total;
-        unsigned long n_filtered;
-        unsigned long n_clean;
-        std::vector< std::vector<unsigned long> > read_len_info;
-        std::vector< std::vector<unsigned long> > filtered_read_info;
-        std::vector< std::vector< std::vector<unsigned long> > > base_info;
-        std::vector< std::vector< std::vector<unsigned long> > > base_quality_info;
-
-        statistic(int n_end, int max_read_len) {
-            n_filtered = 0;
-            n_total = 0;
-            n_clean = 0;
-            read_len_info = std::vector< std::vector<unsigned long> >(2 * n_end, std::vector<unsigned long>(max_read_len));
-            filtered_read_info = std::vector< std::vector<unsigned long> >(n_end, std::vector<unsigned long>(5));
-            base_info = std::vector< std::vector< std::vector<unsigned long> > >(n_end, std::vector< std::vector<unsigned long> >(max_read_len, std::vector<unsigned long>(10)));
-            base_quality_info = std::vector< std::vector< std::vector<unsigned long> > >(n_end * 2, std::vector< std::vector<unsigned long> >(max_read_len, std::vector<unsigned long>(42)));
+    position_histogram::position_histogram(int n_end, int n_pos, int n_symbol)
+            : n_end_(n_end), n_pos_(n_pos), n_symbol_(n_symbol) {
+        const int CACHE_LINE = 64;
+        const int per_line = CACHE_LINE / sizeof(unsigned long);
+        stride = (n_symbol + per_line - 1) / per_line * per_line;
+        size = (size_t)n_end * n_pos * stride;
+        void* p = NULL;
+        if (posix_memalign(&p, CACHE_LINE, std::max(size, (size_t)1) * sizeof(unsigned long)) != 0) {
+            throw std::bad_alloc();
         }
-    };
+        counts = (unsigned long*)p;
+        std::fill(counts, counts + size, 0);
+    }
 
-    std::string log_title() {return "[filterfq | " + to_simple_string(boost::posix_time::second_clock::local_time()) + "] ";}
+    position_histogram::~position_histogram() {
+        free(counts);
+    }
 
-    int* get_read_info(const boost::filesystem::path& filepath) {
-        int* results = new int[5];
-        std::ifstream infile (filepath.string(), std::ios_base::in | std::ios_base::binary);
-        boost::iostreams::filtering_istream decompressor;
-        decompressor.push(boost::iostreams::gzip_decompressor());
-        decompressor.push(infile);
-        std::string line;
+    void position_histogram::grow(int n_pos) {
+        if (n_pos <= n_pos_) {
+            return;
+        }
+        size_t new_size = (size_t)n_end_ * n_pos * stride;
+        void* p = NULL;
+        if (posix_memalign(&p, 64, new_size * sizeof(unsigned long)) != 0) {
+            throw std::bad_alloc();
+        }
+        unsigned long* new_counts = (unsigned long*)p;
+        std::fill(new_counts, new_counts + new_size, 0);
+        for (int end = 0; end < n_end_; end++) {
+            std::copy(counts + (size_t)end * n_pos_ * stride, counts + (size_t)(end + 1) * n_pos_ * stride, new_counts + (size_t)end * n_pos * stride);
+        }
+        free(counts);
+        counts = new_counts;
+        n_pos_ = n_pos;
+        size = new_size;
+    }
 
-        unsigned char min = '~';
-        unsigned char max = '!';
-        int n_read = 0;
-        int max_len = 0;
-        std::pair<std::string::iterator, std::string::iterator> extremum;
-        // boost::random::mt19937 gen;
-        // boost::random::uniform_int_distribution<> dist(1, 10);
-        while (n_read <= 4000000 && getline(decompressor, line)) {
-            for (int i = 0; i < 3; i++)
-                getline(decompressor, line);
-            // if (dist(gen) >= 5) 
-            //     continue;
+    void position_histogram::add(const position_histogram& other) {
+        if (other.n_pos_ == n_pos_) {
+            read_kernels::add_counts(counts, other.counts, size);
+            return;
+        }
+        // the rows of an end are contiguous and start on a cache line
+        grow(other.n_pos_);
+        for (int end = 0; end < n_end_; end++) {
+            read_kernels::add_counts(counts + (size_t)end * n_pos_ * stride, other.counts + (size_t)end * other.n_pos_ * stride, (size_t)other.n_pos_ * stride);
+        }
+    }
+
+    statistic::statistic(int n_end, int max_read_len)
+            : base_info(n_end, max_read_len, 10), base_quality_info(n_end * 2, max_read_len, N_QUALITY_SYMBOL) {
+        n_filtered = 0;
+        n_total = 0;
+        n_clean = 0;
+        read_len_info = std::vector< std::vector<unsigned long> >(2 * n_end, std::vector<unsigned long>(max_read_len));
+        filtered_read_info = std::vector< std::vector<unsigned long> >(n_end, std::vector<unsigned long>(5));
+    }
 
-            if (line.length() > max_len) {
-                max_len = line.length();
+    void statistic::grow(int read_len) {
+        if (read_len <= base_info.n_pos()) {
+            return;
+        }
+        base_info.grow(read_len);
+        base_quality_info.grow(read_len);
+        for (int i = 0; i < read_len_info.size(); i++) {
+            read_len_info[i].resize(read_len);
+        }
+    }
+
+    void statistic::add(const statistic& other) {
+        n_filtered += other.n_filtered;
+        n_total += other.n_total;
+        n_clean += other.n_clean;
+        grow(other.base_info.n_pos());
+        for (int i = 0; i < read_len_info.size(); i++) {
+            for (int j = 0; j < other.read_len_info[i].size(); j++) {
+                read_len_info[i][j] += other.read_len_info[i][j];
+            }
+        }
+        for (int i = 0; i < filtered_read_info.size(); i++) {
+            for (int j = 0; j < filtered_read_info[i].size(); j++) {
+                filtered_read_info[i][j] += other.filtered_read_info[i][j];
             }
+        }
+        base_info.add(other.base_info);
+        base_quality_info.add(other.base_quality_info);
+    }
+
+    std::string log_title() {return "[filterfq | " + to_simple_string(boost::posix_time::second_clock::local_time()) + "] ";}
+
+    // reads looked at between two checks whether the guess is settled
+    const size_t CHECK_BATCH_SIZE = 4096;
+
+    quality_check check_quality_system(const boost::filesystem::path& filepath, unsigned long n_read_needed) {
+        quality_check result;
+        result.file = filepath;
+        result.min_quality = '~';
+        result.max_quality = '!';
+        result.n_read = 0;
+        result.max_read_len = 0;
+        result.quality_system = -1;
 
-            extremum = boost::minmax_element(line.begin(), line.end());
-            if (*extremum.second >= max) {
-                max = *extremum.second;
+        boost::system::error_code ec;
+        if (filepath != "-" && !boost::filesystem::is_regular_file(filepath, ec)) {
+            result.error = "No such file or directory";
+            return result;
+        }
+        try {
+            input_codec::input_istream decompressor(input_codec::input_source(filepath.string()), gzip_codec::STREAM_BUFFER_SIZE);
+            fastq_parser::chunk_reader chunks(decompressor);
+            fastq_pipeline::chunk_ptr chunk;
+            std::vector<fastq_pipeline::fastq_record> reads;
+            while (result.n_read < n_read_needed && !is_quality_system_settled(result.min_quality, result.max_quality)
+                    && chunks.read(std::min(CHECK_BATCH_SIZE, (size_t)(n_read_needed - result.n_read)), chunk, reads)) {
+                for (std::vector<fastq_pipeline::fastq_record>::const_iterator r = reads.begin(); r != reads.end(); r++) {
+                    read_kernels::min_max(r -> quality_line.data, r -> quality_line.size, result.min_quality, result.max_quality);
+                    result.max_read_len = std::max(result.max_read_len, (int)r -> read_line.size);
+                }
+                result.n_read += reads.size();
             }
-            if (*extremum.first <= min) {
-                min = *extremum.first;
+        }
+        catch (std::exception& e) {
+            result.error = e.what();
+            return result;
+        }
+        if (result.n_read == 0) {
+            result.error = "No reads found";
+            return result;
+        }
+        result.quality_system = guess_quality_system(result.min_quality, result.max_quality);
+        return result;
+    }
+
+    // the files of check_quality_systems() and what has become of them
+    struct quality_check_jobs {
+        const std::vector<boost::filesystem::path>* files;
+        unsigned long n_read_needed;
+        const std::function<void(const quality_check&)>* report;
+        std::vector<quality_check> results;
+        std::vector<bool> is_done;
+        size_t next_file;
+        size_t next_report;
+        boost::mutex jobs_mutex;
+    };
+
+    static void quality_checker(quality_check_jobs* jobs) {
+        boost::unique_lock<boost::mutex> lock(jobs -> jobs_mutex);
+        while (jobs -> next_file < jobs -> files -> size()) {
+            size_t i = jobs -> next_file++;
+            lock.unlock();
+            quality_check result = check_quality_system((*jobs -> files)[i], jobs -> n_read_needed);
+            lock.lock();
+            jobs -> results[i] = result;
+            jobs -> is_done[i] = true;
+            while (jobs -> next_report < jobs -> files -> size() && jobs -> is_done[jobs -> next_report]) {
+                (*jobs -> report)(jobs -> results[jobs -> next_report++]);
             }
-            n_read++;
         }
-        results[0] = min;
-        results[1] = max;
-        boost::iostreams::close(decompressor, std::ios_base::in);
+    }
+
+    void check_quality_systems(const std::vector<boost::filesystem::path>& files,
+            unsigned long n_read_needed,
+            int n_thread,
+            const std::function<void(const quality_check&)>& report) {
+        quality_check_jobs jobs;
+        jobs.files = &files;
+        jobs.n_read_needed = n_read_needed;
+        jobs.report = &report;
+        jobs.results.resize(files.size());
+        jobs.is_done.assign(files.size(), false);
+        jobs.next_file = 0;
+        jobs.next_report = 0;
+
+        boost::thread_group checkers;
+        for (int i = 0; i < std::min(n_thread, (int)files.size()); i++) {
+            checkers.create_thread(boost::bind(quality_checker, &jobs));
+        }
+        checkers.join_all();
+    }
+
+    bool is_quality_system_settled(unsigned char min, unsigned char max) {
+        // below ';' only Sanger and Illumina 1.8+ are left and a code above
+        // 'I' rules out Sanger
+        return min < ';' && max > 'I';
+    }
+
+    int guess_quality_system(unsigned char min, unsigned char max) {
         if (min < ';') {
             if (max == 'I') {
                 // sanger
-                results[2] = 0;
+                return 0;
             }
             else {
                 // prefer illumina 1.8+
-                results[2] = 4;
+                return 4;
             }
         }
         else {
             if (min < '@') {
                 // Solexa
-                results[2] = 1;
+                return 1;
             }
             else if (min < 'B') {
                 // illumina 1.3+
-                results[2] = 2;
+                return 2;
             }
             else {
                 // prefer illumina 1.5+
-                results[2] = 3;
+                return 3;
             }
         }
-        results[3] = n_read;
-        results[4] = max_len;
-        return results;
     }
-    
-    float get_base_N_rate(const std::string& read_seq) {
-        return std::count(read_seq.begin(), read_seq.end(), 'N') * 1.0 / read_seq.length(); }
 
-    float get_average_quality(const std::string& quality_seq, const int sys) {
-        unsigned int sum = 0;
-        for (std::string::const_iterator s = quality_seq.begin(); s != quality_seq.end(); s++) {
-            sum += *s;
+    quality_detector::quality_detector(fastq_pipeline::batch_scheduler* batches, unsigned long n_read_needed)
+            : batches(batches), n_read_needed(n_read_needed), min_code('~'), max_code('!'), n_read(0), max_len(0), guess(0), is_settled(false) {}
+
+    void quality_detector::push(fastq_pipeline::read_batch&& batch) {
+        boost::unique_lock<boost::mutex> lock(detector_mutex);
+        if (is_settled) {
+            lock.unlock();
+            batches -> push(std::move(batch));
+            return;
+        }
+        for (std::vector<fastq_pipeline::fastq_record>::const_iterator r = batch.reads[0].begin(); r != batch.reads[0].end(); r++) {
+            read_kernels::min_max(r -> quality_line.data, r -> quality_line.size, min_code, max_code);
+            max_len = std::max(max_len, (int)r -> read_line.size);
+        }
+        n_read += batch.reads[0].size();
+        held.push_back(std::move(batch));
+        // the read count only bounds the wait, most runs settle on the
+        // first batch
+        if (is_quality_system_settled(min_code, max_code) || n_read >= n_read_needed) {
+            settle(lock);
+        }
+    }
+
+    void quality_detector::close() {
+        boost::unique_lock<boost::mutex> lock(detector_mutex);
+        if (!is_settled) {
+            settle(lock);
         }
-        return sum * 1.0 / quality_seq.size() - (quality_system::zero_quality)[sys];
+        batches -> close();
     }
 
-    float get_low_quality_rate(const std::string& quality_seq, const int sys, const int base_quality_threshold) {
-        return std::count_if(quality_seq.begin(), quality_seq.end(), [sys, base_quality_threshold](char q) {return q - (quality_system::zero_quality)[sys] < base_quality_threshold;}) * 1.0 / quality_seq.length();
+    // The waiters are woken before the held batches go out, the workers may
+    // only be started then and the scheduler blocks until they take some.
+    void quality_detector::settle(boost::unique_lock<boost::mutex>& lock) {
+        guess = guess_quality_system(min_code, max_code);
+        is_settled = true;
+        settled.notify_all();
+        lock.unlock();
+        for (std::vector<fastq_pipeline::read_batch>::iterator b = held.begin(); b != held.end(); b++) {
+            batches -> push(std::move(*b));
+        }
+        std::vector<fastq_pipeline::read_batch>().swap(held);
     }
 
-    int* get_base_info(const std::string& base_seq) {
-        int read_len = base_seq.length();
-        int* base_info = new int[read_len + 1];
+    int quality_detector::quality_system() {
+        boost::unique_lock<boost::mutex> lock(detector_mutex);
+        while (!is_settled) {
+            settled.wait(lock);
+        }
+        return guess;
+    }
+    
+    // One pass over sequence and one over quality gathering everything the
+    // filters and the raw statistics need, done by the SIMD read kernels.
+    // Both buffers hold at least read length + 1 ints.
+    void evaluate_read(const fastq_pipeline::line_view& read_seq,
+            const fastq_pipeline::line_view& quality_seq,
+            const int quality_sys,
+            const int base_quality_threshold,
+            int* base_info,
+            int* base_quality_info,
+            read_summary& summary) {
+        int read_len = read_seq.length();
+        int quality_len = quality_seq.length();
+        int zero = quality_system::zero_quality[quality_sys];
+        long quality_sum = 0;
+        size_t n_low_quality = 0;
+
         base_info[0] = read_len;
-        for (int i = 1; i < read_len + 1; i++) {
-           switch(base_seq[i - 1]) {
-               case 'A':
-                   base_info[i] = 0;
-                   break;
-               case 'C':
-                   base_info[i] = 1;
-                   break;
-               case 'G':
-                   base_info[i] = 2;
-                   break;
-               case 'T':
-                   base_info[i] = 3;
-                   break;
-               case 'N':
-                   base_info[i] = 4;
-                   break;
-           }
-        }
-        return base_info;
-    }
-
-    int* get_base_quality_info(const std::string& quality_seq, const int quality_sys) {
+        base_quality_info[0] = quality_len;
+        int n_base_N = read_kernels::scan_bases(read_seq.data, read_len, base_info + 1);
+        read_kernels::scan_qualities(quality_seq.data, quality_len, zero, zero + base_quality_threshold, base_quality_info + 1, quality_sum, n_low_quality);
+
+        summary.read_len = read_len;
+        summary.quality_len = quality_len;
+        summary.zero_quality = zero;
+        summary.n_base_N = n_base_N;
+        summary.quality_sum = quality_sum;
+        summary.n_low_quality = n_low_quality;
+    }
+
+    // Quality values above the table are counted in its last bin. They are
+    // clamped only here, trimming still sees them as they are.
+    static inline int quality_symbol(int quality) {
+        return std::min(quality, N_QUALITY_SYMBOL - 1);
+    }
+
+    // fills the caller's buffer of at least read length + 1 ints
+    int* get_base_quality_info(const fastq_pipeline::line_view& quality_seq, const int quality_sys, int* base_quality_info) {
         int read_len = quality_seq.length();
-        int* base_quality_info = new int[read_len + 1];
         base_quality_info[0] = read_len;
         for (int i = 1; i < read_len + 1; i++) {
-            (quality_seq[i - 1] - quality_system::zero_quality[quality_sys] >= 0) ? base_quality_info[i] = quality_seq[i - 1] - quality_system::zero_quality[quality_sys] : base_quality_info[i] = 0;
+            (quality_seq.data[i - 1] - quality_system::zero_quality[quality_sys] >= 0) ? base_quality_info[i] = quality_seq.data[i - 1] - quality_system::zero_quality[quality_sys] : base_quality_info[i] = 0;
         }
         return base_quality_info;
     }
 
-    std::unordered_set<std::string> load_adapter(boost::filesystem::path& adapter_file) {
-        std::unordered_set<std::string> adapter_read_id_list;
+    // fingerprints the first field of every line in the chunks it takes
+    static void parse_adapter_chunks(fastq_pipeline::bounded_queue<fastq_pipeline::chunk_ptr>* chunks, std::vector<uint64_t>* keys) {
+        fastq_pipeline::chunk_ptr chunk;
+        while (chunks -> pop(chunk)) {
+            const char* p = chunk -> data();
+            const char* end = p + chunk -> size();
+            while (p < end) {
+                const char* line_end = (const char*)memchr(p, '\n', end - p);
+                if (line_end == NULL) {
+                    line_end = end;
+                }
+                const char* field_end = (const char*)memchr(p, '\t', line_end - p);
+                if (field_end == NULL) {
+                    field_end = line_end;
+                }
+                keys -> push_back(read_id_index::fingerprint(p, field_end - p));
+                p = line_end + 1;
+            }
+        }
+    }
 
-        std::ifstream inadapter(adapter_file.string(), std::ios_base::in | std::ios_base::binary);
-        boost::iostreams::filtering_istream inadapter_decompressor;
-        inadapter_decompressor.push(boost::iostreams::gzip_decompressor());
-        inadapter_decompressor.push(inadapter);
+    // The list is inflated in one thread and cut into chunks of whole lines
+    // that n_thread threads parse in parallel. With use_cache the index is
+    // saved next to the list as <list>.idx and mapped from there by later
+    // runs, as long as the list keeps its size and modification time.
+    read_id_index::fingerprint_set load_adapter(boost::filesystem::path& adapter_file, int n_thread, bool use_cache) {
+        read_id_index::fingerprint_set adapter_read_id_list;
+        std::string cache_filename = adapter_file.string() + ".idx";
+        unsigned long source_size = boost::filesystem::file_size(adapter_file);
+        long source_mtime = boost::filesystem::last_write_time(adapter_file);
+        if (use_cache && adapter_read_id_list.load(cache_filename, source_size, source_mtime)) {
+            std::cout << log_title() << "INFO -- " << adapter_read_id_list.size()
+                << " read ID have been mapped from " << cache_filename << "." << std::endl;
+            return adapter_read_id_list;
+        }
 
-        std::cout << log_title() << "INFO -- Loading adapter list(s)..." << std::endl;
+        std::cout << log_title() << "INFO -- Loading adapter list " << adapter_file.string() << "..." << std::endl;
+        input_codec::input_istream inadapter_decompressor(input_codec::input_source(adapter_file.string()), gzip_codec::STREAM_BUFFER_SIZE);
         std::string line;
-        std::vector<std::string> line_splited;
-        getline(inadapter_decompressor, line); // read out the header 
-        while (getline(inadapter_decompressor, line)) {
-            boost::split(line_splited, line, boost::is_any_of("\t"));
-            adapter_read_id_list.insert(line_splited[0]);
-            if (adapter_read_id_list.size() % 10000 == 0) {
-                std::cout << log_title() << "INFO -- "
-                    << adapter_read_id_list.size() << " read ID have been loaded." << std::endl;
+        getline(inadapter_decompressor, line); // read out the header
+
+        fastq_pipeline::bounded_queue<fastq_pipeline::chunk_ptr> chunks(2 * n_thread);
+        std::vector< std::vector<uint64_t> > keys(n_thread);
+        boost::thread_group parsers;
+        for (int i = 0; i < n_thread; i++) {
+            parsers.create_thread(boost::bind(parse_adapter_chunks, &chunks, &keys[i]));
+        }
+        std::string carry;
+        while (true) {
+            fastq_pipeline::chunk_ptr chunk = std::make_shared<std::string>();
+            chunk -> swap(carry);
+            size_t filled = chunk -> size();
+            chunk -> resize(filled + ADAPTER_CHUNK_SIZE);
+            inadapter_decompressor.read(&(*chunk)[filled], ADAPTER_CHUNK_SIZE);
+            size_t n_read = inadapter_decompressor.gcount();
+            chunk -> resize(filled + n_read);
+            if (n_read == 0) {
+                // the last line has no newline
+                if (!chunk -> empty()) {
+                    chunks.push(std::move(chunk));
+                }
+                break;
+            }
+            size_t last_newline = chunk -> rfind('\n');
+            if (last_newline == std::string::npos) {
+                carry.swap(*chunk);
+                continue;
             }
+            carry.assign(*chunk, last_newline + 1, std::string::npos);
+            chunk -> resize(last_newline + 1);
+            chunks.push(std::move(chunk));
         }
+        chunks.close();
+        parsers.join_all();
+
+        for (int i = 0; i < n_thread; i++) {
+            adapter_read_id_list.insert(keys[i].data(), keys[i].data() + keys[i].size());
+            std::vector<uint64_t>().swap(keys[i]);
+        }
+        adapter_read_id_list.build(n_thread);
         std::cout << log_title() << "INFO -- Totally "
             << adapter_read_id_list.size() << " have been loaded." << std::endl;
+
+        if (use_cache) {
+            if (adapter_read_id_list.save(cache_filename, source_size, source_mtime)) {
+                std::cout << log_title() << "INFO -- The read ID index is saved to " << cache_filename << "." << std::endl;
+            }
+            else {
+                std::cout << log_title() << "WARN -- Failed to save the read ID index to " << cache_filename << "." << std::endl;
+            }
+        }
         return adapter_read_id_list;
     }
 
-    void trim_read(std::string& seq, int left_trim, int right_trim, int min_len) {
-        if (seq.size() - left_trim - right_trim < min_len) {
-            return;
+    // trims the view, the bytes stay in the chunk; false when nothing was
+    // cut, also when less than min_len bases (and never none) would be left
+    bool trim_read(fastq_pipeline::line_view& seq, int left_trim, int right_trim, int min_len) {
+        if ((long)seq.size - left_trim - right_trim < std::max(min_len, 1) || left_trim + right_trim == 0) {
+            return false;
         }
         else {
-            seq.erase(0, left_trim);
-            seq.erase(seq.size() - right_trim, right_trim);
+            seq.data += left_trim;
+            seq.size -= left_trim + right_trim;
+            return true;
         }
     }
 
-    void processor(std::vector<boost::filesystem::path>& infiles,
-            std::vector<boost::filesystem::path>& clean_outfiles,
-            std::vector<boost::filesystem::path>& dropped_outfiles,
-            boost::filesystem::path& tmp_dir,
-            std::vector< std::unordered_set<std::string> >& adapter_read_id_lists,
+    // keeps the first bases of a read and as many qualities
+    void cut_read(fastq_pipeline::line_view& seq, fastq_pipeline::line_view& quality, size_t keep_len) {
+        seq.size = keep_len;
+        quality.size = std::min(quality.size, keep_len);
+    }
+
+    // The 3' quality trimming works on the qualities evaluate_read() left in
+    // base_quality_info. The read is first cut at the first window whose
+    // average quality is below window_quality, then where the running sum of
+    // tail_quality - quality from the 3' end peaks, as BWA does; a window
+    // size or tail quality of 0 leaves that step out. The summary is redone
+    // over the bases kept, returns how many they are.
+    int trim_quality(const int* base_info,
+            const int* base_quality_info,
+            const int base_quality_threshold,
+            const int window_size,
+            const float window_quality,
+            const int tail_quality,
+            read_summary& summary) {
+        const int* qualities = base_quality_info + 1;
+        int keep_len = base_quality_info[0];
+        if (window_size > 0 && keep_len > 0) {
+            int window = std::min(window_size, keep_len);
+            float min_sum = window_quality * window;
+            long sum = 0;
+            for (int i = 0; i < window; i++) {
+                sum += qualities[i];
+            }
+            int start = 0;
+            while (sum >= min_sum && start + window < keep_len) {
+                sum += qualities[start + window] - qualities[start];
+                start++;
+            }
+            if (sum < min_sum) {
+                keep_len = start;
+            }
+        }
+        if (tail_quality > 0) {
+            long sum = 0;
+            long max_sum = 0;
+            int end = keep_len;
+            for (int i = keep_len - 1; i >= 0; i--) {
+                sum += tail_quality - qualities[i];
+                if (sum < 0) {
+                    break;
+                }
+                if (sum > max_sum) {
+                    max_sum = sum;
+                    end = i;
+                }
+            }
+            keep_len = end;
+        }
+        keep_len = std::min(keep_len, base_info[0]);
+
+        if (keep_len > 0 && keep_len < base_quality_info[0]) {
+            long quality_sum = 0;
+            int n_low_quality = 0;
+            int n_base_N = 0;
+            for (int i = 0; i < keep_len; i++) {
+                quality_sum += qualities[i];
+                n_low_quality += qualities[i] < base_quality_threshold;
+                n_base_N += base_info[i + 1] == 4;
+            }
+            summary.read_len = keep_len;
+            summary.quality_len = keep_len;
+            summary.n_base_N = n_base_N;
+            summary.quality_sum = quality_sum + (long)summary.zero_quality * keep_len;
+            summary.n_low_quality = n_low_quality;
+        }
+        return keep_len;
+    }
+
+    // reads the records whose headers lie in the BGZF blocks [begin, end),
+    // the segment is closed by a batch without reads
+    static void read_bgzf_segment(const std::string& infile,
+            unsigned long begin,
+            unsigned long end,
+            fastq_pipeline::bounded_queue<fastq_pipeline::read_batch>* segment_batches,
+            int batch_size) {
+        block_decompressor::bgzf_range_reader infq(infile, begin);
+        bool is_exhausted = begin != 0 && !infq.sync_record();
+
+        std::string line;
+        size_t chunk_size = 0;
+        while (!is_exhausted) {
+            fastq_pipeline::read_batch batch;
+            batch.chunks.push_back(std::make_shared<std::string>());
+            batch.reads.resize(1);
+            batch.reads[0].reserve(batch_size);
+
+            // the lines are gathered into one chunk the records then point into
+            std::string& chunk = *batch.chunks[0];
+            chunk.reserve(chunk_size);
+            for (int n = 0; n < batch_size; n++) {
+                if (!infq.getline(line) || infq.is_past(end)) {
+                    is_exhausted = true;
+                    break;
+                }
+                chunk.append(line).push_back('\n');
+                for (int i = 0; i < 3; i++) {
+                    infq.getline(line);
+                    chunk.append(line).push_back('\n');
+                }
+            }
+            chunk_size = std::max(chunk_size, chunk.size());
+            fastq_parser::parse_chunk(chunk, batch.reads[0]);
+
+            if (!batch.reads[0].empty()) {
+                segment_batches -> push(std::move(batch));
+            }
+        }
+        segment_batches -> push(fastq_pipeline::read_batch());
+    }
+
+    // decompresses the segments first, first + step, ... one after another
+    static void read_bgzf_segments(const std::string& infile,
+            const std::vector<unsigned long>& offsets,
+            int first,
+            int step,
+            fastq_pipeline::bounded_queue<fastq_pipeline::read_batch>* segment_batches,
+            int batch_size) {
+        for (int i = first; i + 1 < offsets.size(); i += step) {
+            read_bgzf_segment(infile, offsets[i], offsets[i + 1], segment_batches, batch_size);
+        }
+    }
+
+    // The records of plain input in [begin, end) of the mapped file, there is
+    // nothing to decompress and a batch is cut after 4 x batch_size lines.
+    // Its bytes are copied out of the mapping since the records are rewritten
+    // in place later on.
+    static void read_plain_segment(const input_codec::mapped_file* infile,
+            unsigned long begin,
+            unsigned long end,
+            fastq_pipeline::bounded_queue<fastq_pipeline::read_batch>* segment_batches,
+            int batch_size) {
+        const char* data = infile -> data();
+        unsigned long pos = begin;
+        while (pos < end) {
+            unsigned long cut = pos;
+            for (int n = 0; n < 4 * batch_size && cut < end; n++) {
+                const char* newline = (const char*)memchr(data + cut, '\n', end - cut);
+                cut = (newline == NULL) ? end : newline - data + 1;
+            }
+            fastq_pipeline::read_batch batch;
+            batch.chunks.push_back(std::make_shared<std::string>(data + pos, cut - pos));
+            batch.reads.resize(1);
+            batch.reads[0].reserve(batch_size);
+            std::string& chunk = *batch.chunks[0];
+            if (chunk[chunk.size() - 1] != '\n') {
+                // the last line of the file has no newline
+                chunk.push_back('\n');
+            }
+            fastq_parser::parse_chunk(chunk, batch.reads[0]);
+            if (!batch.reads[0].empty()) {
+                segment_batches -> push(std::move(batch));
+            }
+            pos = cut;
+        }
+        segment_batches -> push(fastq_pipeline::read_batch());
+    }
+
+    static void read_plain_segments(const input_codec::mapped_file* infile,
+            const std::vector<unsigned long>& offsets,
+            int first,
+            int step,
+            fastq_pipeline::bounded_queue<fastq_pipeline::read_batch>* segment_batches,
+            int batch_size) {
+        for (int i = first; i + 1 < offsets.size(); i += step) {
+            read_plain_segment(infile, offsets[i], offsets[i + 1], segment_batches, batch_size);
+        }
+    }
+
+    void reader(std::vector<boost::filesystem::path>& infiles,
+            quality_detector* detector,
+            int batch_size,
+            int n_shard,
+            std::string* error) {
+        int n_end = infiles.size();
+
+        // stdin is only told from its first bytes once it is opened below
+        bool is_stdin = false;
+        std::vector<input_codec::input_format> formats;
+        for (int i = 0; i < n_end; i++) {
+            formats.push_back(input_codec::detect_format(infiles[i].string()));
+            if (infiles[i] == "-") {
+                is_stdin = true;
+                continue;
+            }
+            std::cout << log_title() << "INFO -- Reading " << infiles[i].string() << " as "
+                << input_codec::format_name(formats[i]) << "." << std::endl;
+        }
+
+        // Single-end BGZF and plain input are cut into segments, of about
+        // BGZF_SEGMENT_SIZE compressed or PLAIN_SEGMENT_SIZE bytes, that
+        // n_shard threads read in parallel, thread i taking segments i,
+        // i + n_shard, ... The batches are passed on segment by segment, so
+        // they keep the order of the input while the threads work ahead.
+        if (n_end == 1 && n_shard > 1 && !is_stdin && (formats[0] == input_codec::BGZF || formats[0] == input_codec::PLAIN)) {
+            std::vector<unsigned long> offsets;
+            std::unique_ptr<input_codec::mapped_file> mapped;
+            if (formats[0] == input_codec::BGZF) {
+                int n_segment = std::max((unsigned long)n_shard, boost::filesystem::file_size(infiles[0]) / BGZF_SEGMENT_SIZE);
+                offsets = block_decompressor::split_bgzf(infiles[0].string(), n_segment);
+            }
+            else {
+                mapped.reset(new input_codec::mapped_file(infiles[0].string()));
+                int n_segment = std::max((unsigned long)n_shard, mapped -> size() / PLAIN_SEGMENT_SIZE);
+                offsets = input_codec::split_records(*mapped, n_segment);
+            }
+            n_shard = std::min(n_shard, (int)offsets.size() - 1);
+            std::cout << log_title() << "INFO -- " << ((mapped) ? "Parsing" : "Decompressing") << " its "
+                << offsets.size() - 1 << " ranges with " << n_shard << " threads in parallel." << std::endl;
+
+            std::vector< std::unique_ptr< fastq_pipeline::bounded_queue<fastq_pipeline::read_batch> > > shard_batches;
+            boost::thread_group shard_threads;
+            for (int i = 0; i < n_shard; i++) {
+                shard_batches.emplace_back(new fastq_pipeline::bounded_queue<fastq_pipeline::read_batch>(SEGMENT_BATCHES));
+                if (mapped) {
+                    shard_threads.create_thread(boost::bind(read_plain_segments, mapped.get(), offsets, i, n_shard, shard_batches[i].get(), batch_size));
+                }
+                else {
+                    shard_threads.create_thread(boost::bind(read_bgzf_segments, infiles[0].string(), offsets, i, n_shard, shard_batches[i].get(), batch_size));
+                }
+            }
+            unsigned long serial = 0;
+            for (int i = 0; i + 1 < offsets.size(); i++) {
+                fastq_pipeline::read_batch batch;
+                while (shard_batches[i % n_shard] -> pop(batch) && !batch.reads.empty()) {
+                    batch.serial = serial++;
+                    detector -> push(std::move(batch));
+                }
+            }
+            shard_threads.join_all();
+            detector -> close();
+            return;
+        }
+
+        std::vector< std::unique_ptr<input_codec::input_istream> > infq_decompressor;
+        std::vector< std::unique_ptr<fastq_parser::chunk_reader> > chunk_readers;
+        for (int i = 0; i < n_end; i++) {
+            // the format of stdin could not be checked before the run, a
+            // failure closes the detector so the pipeline drains and main
+            // reports it
+            std::unique_ptr<input_codec::input_source> source;
+            try {
+                source.reset(new input_codec::input_source(infiles[i].string()));
+            }
+            catch (std::exception& e) {
+                *error = std::string(e.what()) + ": " + infiles[i].string();
+                detector -> close();
+                return;
+            }
+            if (infiles[i] == "-") {
+                std::cout << log_title() << "INFO -- Reading stdin as " << input_codec::format_name(source -> format()) << "." << std::endl;
+            }
+            infq_decompressor.emplace_back(new input_codec::input_istream(*source, gzip_codec::STREAM_BUFFER_SIZE));
+            chunk_readers.emplace_back(new fastq_parser::chunk_reader(*infq_decompressor[i]));
+        }
+
+        unsigned long serial = 0;
+        bool is_exhausted = false;
+        while (!is_exhausted) {
+            fastq_pipeline::read_batch batch;
+            batch.serial = serial++;
+            batch.chunks.resize(n_end);
+            batch.reads.resize(n_end);
+            for (int i = 0; i < n_end; i++) {
+                batch.reads[i].reserve(batch_size);
+                if (!chunk_readers[i] -> read(batch_size, batch.chunks[i], batch.reads[i])) {
+                    is_exhausted = true;
+                }
+            }
+
+            // a pair is only kept when all ends have it
+            size_t n_read = batch.reads[0].size();
+            for (int i = 0; i < n_end; i++) {
+                n_read = std::min(n_read, batch.reads[i].size());
+            }
+            for (int i = 0; i < n_end; i++) {
+                if (batch.reads[i].size() > n_read) {
+                    batch.reads[i].resize(n_read);
+                    is_exhausted = true;
+                }
+            }
+            if (n_read < batch_size) {
+                is_exhausted = true;
+            }
+
+            if (n_read > 0) {
+                detector -> push(std::move(batch));
+            }
+        }
+
+        for (int i = 0; i < n_end; i++) {
+            close(*infq_decompressor[i], std::ios_base::in);
+        }
+        detector -> close();
+    }
+
+    void processor(fastq_pipeline::batch_scheduler* batches,
+            std::vector<fastq_pipeline::record_queue*>& clean_queues,
+            std::vector<fastq_pipeline::record_queue*>& dropped_queues,
+            std::vector<read_id_index::fingerprint_set>& adapter_read_id_lists,
+            const adapter_trimmer::adapter_set* adapters,
             int* param_int,
             float* param_float,
             statistic* stat,
-            int* thread_info) {
-        int stepsize = thread_info[0];
-        int n_thread = thread_info[1];
-        int thread = thread_info[2];
-        
+            int thread) {
+        int n_end = clean_queues.size();
+
         int min_base_quality = param_int[0];
         int raw_quality_sys = param_int[1];
         int clean_quality_sys = param_int[2];
         int max_read_len = param_int[3];
         int min_read_len = param_int[4];
-        int * trim_crit = new int[infiles.size() * 2];
-        for (int i = 0; i < infiles.size() * 2; i++) {
+        int * trim_crit = new int[n_end * 2];
+        for (int i = 0; i < n_end * 2; i++) {
             trim_crit[i] = param_int[5 + i];
         }
+        // a read cut by an adapter or quality trimming is still trimmed by
+        // --trim after that, what is left then has to be min_read_len long
+        std::vector<size_t> min_keep_len(n_end);
+        for (int i = 0; i < n_end; i++) {
+            min_keep_len[i] = std::max(min_read_len, 1) + trim_crit[2 * i] + trim_crit[2 * i + 1];
+        }
 
         float max_base_N_rate = param_float[0];
         float min_ave_quality = param_float[1];
         float max_low_quality_rate = param_float[2];
 
-        if (infiles.size() == 1) {
-            // file stream
-            std::ifstream infq(infiles[0].string(), std::ios_base::in | std::ios_base::binary);
-            boost::iostreams::filtering_istream infq_decompressor;
-            infq_decompressor.push(boost::iostreams::gzip_decompressor());
-            infq_decompressor.push(infq);
-
-            std::ofstream clean_outfq((tmp_dir / clean_outfiles[0].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary); 
-            boost::iostreams::filtering_ostream clean_outfq_compressor;
-            clean_outfq_compressor.push(boost::iostreams::gzip_compressor());
-            clean_outfq_compressor.push(clean_outfq);
-
-            std::ofstream dropped_outfq((tmp_dir / dropped_outfiles[0].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary);
-            boost::iostreams::filtering_ostream dropped_outfq_compressor;
-            dropped_outfq_compressor.push(boost::iostreams::gzip_compressor());
-            dropped_outfq_compressor.push(dropped_outfq);
-            
+        int window_size = param_int[7 + n_end * 2];
+        int tail_quality = param_int[8 + n_end * 2];
+        float window_quality = param_float[4];
+        bool use_quality_trimming = window_size > 0 || tail_quality > 0;
+
+        fastq_pipeline::read_batch batch;
+#ifdef COUNT_ALLOCATIONS
+        unsigned long n_batch = 0;
+        unsigned long n_read_allocation = 0;
+#endif
+        if (n_end == 1) {
             statistic local_counter(1, max_read_len);
-            unsigned int step_counter = 0;
-            int* base_info;
-            int* base_quality_info;
-            int* clean_base_info;
-            int* clean_base_quality_info;
-            std::string read_id_line, read_line, plus_line, quality_line;
+            int* base_info = new int[max_read_len + 1];
+            int* base_quality_info = new int[max_read_len + 1];
+            int* clean_base_quality_info = new int[max_read_len + 1];
+            read_summary summary;
             bool is_filtered;
 
-            for (int i = 0; i < stepsize * thread; i++) {
-                for (int j = 0; j < 4; j++) {
-                    getline(infq_decompressor, read_id_line);
-                }
-            }
+            while (batches -> pop(thread, batch)) {
+                fastq_pipeline::record_batch clean_records;
+                fastq_pipeline::record_batch dropped_records;
+                clean_records.chunk = batch.chunks[0];
+                dropped_records.chunk = batch.chunks[0];
+                clean_records.records.reserve(batch.reads[0].size());
+                dropped_records.records.reserve(batch.reads[0].size());
+#ifdef COUNT_ALLOCATIONS
+                unsigned long n_allocation_before = allocation_counter::count();
+#endif
 
-            while (getline(infq_decompressor, read_id_line)) {
-                getline(infq_decompressor, read_line);
-                getline(infq_decompressor, plus_line);
-                getline(infq_decompressor, quality_line);
+                for (std::vector<fastq_pipeline::fastq_record>::iterator r = batch.reads[0].begin(); r != batch.reads[0].end(); r++) {
+                    fastq_pipeline::line_view& read_id_line = r -> read_id_line;
+                    fastq_pipeline::line_view& read_line = r -> read_line;
+                    fastq_pipeline::line_view& quality_line = r -> quality_line;
 
-                if (read_line.length() > max_read_len) {
-                    std::cout << log_title() << "ERROR -- There are reads whose length (" << read_line.length() << ") exceeds the maximum read length (" << max_read_len << ") so that segmentation fault may occur. Please set the argument of the parameter \'-maxReadLen/-l\' as one integer larger than or equal to " << read_line.length() << "." << std::endl;
-                    exit(1);
-                }
+                    // the buffers and statistics make room for reads longer than any before
+                    if (std::max(read_line.length(), quality_line.length()) > (size_t)max_read_len) {
+                        max_read_len = std::max(read_line.length(), quality_line.length());
+                        delete [] base_info;
+                        delete [] base_quality_info;
+                        delete [] clean_base_quality_info;
+                        base_info = new int[max_read_len + 1];
+                        base_quality_info = new int[max_read_len + 1];
+                        clean_base_quality_info = new int[max_read_len + 1];
+                        local_counter.grow(max_read_len);
+                    }
 
-                base_info = get_base_info(read_line);
-                base_quality_info = get_base_quality_info(quality_line, raw_quality_sys);
-                is_filtered = false;
+                    evaluate_read(read_line, quality_line, raw_quality_sys, min_base_quality, base_info, base_quality_info, summary);
+                    is_filtered = false;
+                    // the filters below judge only what quality trimming keeps
+                    size_t quality_end = read_line.size;
+                    if (use_quality_trimming) {
+                        quality_end = trim_quality(base_info, base_quality_info, min_base_quality, window_size, window_quality, tail_quality, summary);
+                    }
 
-                local_counter.read_len_info[0][base_info[0] - 1]++;
-                if (get_base_N_rate(read_line) > max_base_N_rate) {
-                    local_counter.filtered_read_info[0][0]++;
-                    if (!is_filtered) {
-                        local_counter.n_filtered++;
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered = true;
+                    local_counter.read_len_info[0][base_info[0] - 1]++;
+                    if (summary.base_N_rate() > max_base_N_rate) {
+                        local_counter.filtered_read_info[0][0]++;
+                        if (!is_filtered) {
+                            local_counter.n_filtered++;
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered = true;
+                        }
                     }
-                }
-                if (get_average_quality(quality_line, raw_quality_sys) < min_ave_quality) {
-                    local_counter.filtered_read_info[0][1]++;
-                    if (!is_filtered) {
-                        local_counter.n_filtered++;
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered = true;
+                    if (summary.average_quality() < min_ave_quality) {
+                        local_counter.filtered_read_info[0][1]++;
+                        if (!is_filtered) {
+                            local_counter.n_filtered++;
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered = true;
+                        }
                     }
-                }
-                if (get_low_quality_rate(quality_line, raw_quality_sys, min_base_quality) > max_low_quality_rate) {
-                    local_counter.filtered_read_info[0][2]++;
-                    if (!is_filtered) {
-                        local_counter.n_filtered++;
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered = true;
+                    if (summary.low_quality_rate() > max_low_quality_rate) {
+                        local_counter.filtered_read_info[0][2]++;
+                        if (!is_filtered) {
+                            local_counter.n_filtered++;
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered = true;
+                        }
                     }
-                }
-                if (adapter_read_id_lists.size() != 0) {
-                    std::string s = read_id_line.substr(1, read_id_line.size() - 1);
-                    if (adapter_read_id_lists[0].count(s) > 0) {
-                        local_counter.filtered_read_info[0][3]++;
+                    // a read both listed and matched counts once with an adapter
+                    bool is_adapter_listed = false;
+                    if (adapter_read_id_lists.size() != 0) {
+                        if (adapter_read_id_lists[0].contains(read_id_line.data + 1, read_id_line.size - 1)) {
+                            is_adapter_listed = true;
+                            local_counter.filtered_read_info[0][3]++;
+                            if (!is_filtered) {
+                                local_counter.n_filtered++;
+                                local_counter.filtered_read_info[0][4]++;
+                                is_filtered = true;
+                            }
+                        }
+                    }
+                    // a read with an adapter is cut there, it is dropped only
+                    // when too little is left
+                    size_t adapter_start = read_line.size;
+                    if (!adapters -> empty()) {
+                        adapter_start = adapters -> find(read_line.data, read_line.size);
+                        if (adapter_start < read_line.size) {
+                            if (!is_adapter_listed) {
+                                local_counter.filtered_read_info[0][3]++;
+                            }
+                            if (adapter_start < min_keep_len[0] && !is_filtered) {
+                                local_counter.n_filtered++;
+                                local_counter.filtered_read_info[0][4]++;
+                                is_filtered = true;
+                            }
+                        }
+                    }
+                    // too short after quality trimming counts as too many low quality bases
+                    if (quality_end < read_line.size && quality_end < min_keep_len[0]) {
+                        local_counter.filtered_read_info[0][2]++;
                         if (!is_filtered) {
                             local_counter.n_filtered++;
                             local_counter.filtered_read_info[0][4]++;
                             is_filtered = true;
                         }
                     }
-                }
 
-                local_counter.n_total++;
-                for (int i = 1; i < base_info[0] + 1; i++) {
-                    local_counter.base_info[0][i - 1][base_info[i]]++;
-                    local_counter.base_quality_info[0][i - 1][base_quality_info[i]]++;
-                }
-                // if (verbose && counter[0] % 50000 == 0) {
-                //     std::cout << log_title() << "INFO " 
-                //         << std::fixed
-                //         << std::setw(12) << std::setprecision(6) << counter[0] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[1] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[1] * 100.0 / counter[0] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[2] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[3] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[4] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[5] << " | "
-                //         << std::endl;
-                // }
-                // mutex.unlock();
-
-                if (!is_filtered) {
-                    local_counter.n_clean++;
-                    trim_read(read_line, trim_crit[0], trim_crit[1], min_read_len);
-                    trim_read(quality_line, trim_crit[0], trim_crit[1], min_read_len);
-                    clean_base_info = get_base_info(read_line);
-                    local_counter.read_len_info[1][clean_base_info[0] - 1]++;
-                    if (raw_quality_sys != clean_quality_sys) {
-                        quality_system::quality_system_convert(quality_line, raw_quality_sys, clean_quality_sys);
-                    }
-                    clean_base_quality_info = get_base_quality_info(quality_line, clean_quality_sys);
-                    for (int i = 1; i < clean_base_quality_info[0] + 1; i++) {
-                        local_counter.base_info[0][i - 1][clean_base_info[i] + 5]++;
-                        local_counter.base_quality_info[1][i - 1][clean_base_quality_info[i]]++;
-                    }
-                    clean_outfq_compressor << read_id_line << std::endl
-                        << read_line << std::endl
-                        << plus_line << std::endl
-                        << quality_line << std::endl;
-                    delete [] clean_base_info;
-                    delete [] clean_base_quality_info;
-                }
-                else {
-                    if (raw_quality_sys != clean_quality_sys) {
-                        quality_system::quality_system_convert(quality_line, raw_quality_sys, clean_quality_sys);
+                    local_counter.n_total++;
+                    for (int i = 1; i < base_info[0] + 1; i++) {
+                        local_counter.base_info(0, i - 1, base_info[i])++;
+                        local_counter.base_quality_info(0, i - 1, quality_symbol(base_quality_info[i]))++;
                     }
-                    dropped_outfq_compressor << read_id_line << std::endl
-                        << read_line << std::endl
-                        << plus_line << std::endl
-                        << quality_line << std::endl;
-                }
 
-                step_counter++;
-                if (step_counter % stepsize == 0) {
-                    for (int i = 0; i < stepsize * (n_thread - 1); i++) {
-                        for (int j = 0; j < 4; j++) {
-                            getline(infq_decompressor, read_id_line);
+                    if (!is_filtered) {
+                        local_counter.n_clean++;
+                        const char* read_begin = read_line.data;
+                        size_t keep_len = std::min(adapter_start, quality_end);
+                        if (keep_len < read_line.size) {
+                            cut_read(read_line, quality_line, keep_len);
+                            r -> is_intact = false;
+                        }
+                        bool is_read_trimmed = trim_read(read_line, trim_crit[0], trim_crit[1], min_read_len);
+                        bool is_quality_trimmed = trim_read(quality_line, trim_crit[0], trim_crit[1], min_read_len);
+                        if (is_read_trimmed || is_quality_trimmed) {
+                            r -> is_intact = false;
+                        }
+                        // the clean bases are the raw ones less what was cut from the left
+                        int left_trim = read_line.data - read_begin;
+                        local_counter.read_len_info[1][read_line.length() - 1]++;
+                        if (raw_quality_sys != clean_quality_sys) {
+                            quality_system::quality_system_convert(quality_line.data, quality_line.size, raw_quality_sys, clean_quality_sys);
+                        }
+                        get_base_quality_info(quality_line, clean_quality_sys, clean_base_quality_info);
+                        for (int i = 1; i < clean_base_quality_info[0] + 1; i++) {
+                            local_counter.base_info(0, i - 1, base_info[left_trim + i] + 5)++;
+                            local_counter.base_quality_info(1, i - 1, quality_symbol(clean_base_quality_info[i]))++;
                         }
+                        clean_records.records.push_back(*r);
                     }
+                    else {
+                        if (raw_quality_sys != clean_quality_sys) {
+                            quality_system::quality_system_convert(quality_line.data, quality_line.size, raw_quality_sys, clean_quality_sys);
+                        }
+                        dropped_records.records.push_back(*r);
+                    }
+                }
+#ifdef COUNT_ALLOCATIONS
+                // the first batch only warms up the reused buffers
+                if (n_batch++ > 0) {
+                    n_read_allocation += allocation_counter::count() - n_allocation_before;
                 }
-                delete [] base_info;
-                delete [] base_quality_info;
+#endif
+
+                clean_queues[0] -> push(batch.serial, std::move(clean_records));
+                dropped_queues[0] -> push(batch.serial, std::move(dropped_records));
             }
-            close(infq_decompressor, std::ios_base::in);
-            close(clean_outfq_compressor, std::ios_base::out);
-            close(dropped_outfq_compressor, std::ios_base::out);
+            delete [] base_info;
+            delete [] base_quality_info;
+            delete [] clean_base_quality_info;
 
             mutex.lock();
-            (*stat).n_filtered += local_counter.n_filtered;
-            (*stat).n_total += local_counter.n_total;
-            (*stat).n_clean += local_counter.n_clean;
-            for (int i = 0; i < infiles.size(); i++) {
-                for (int j = 0; j < (*stat).read_len_info[i].size(); j++) {
-                    (*stat).read_len_info[2 * i][j] += local_counter.read_len_info[2 * i][j];
-                    (*stat).read_len_info[2 * i + 1][j] += local_counter.read_len_info[2 * i + 1][j];
-                }
-                for (int j = 0; j < (*stat).filtered_read_info[i].size(); j++) {
-                    (*stat).filtered_read_info[i][j] += local_counter.filtered_read_info[i][j];
-                }
-                for (int j = 0; j < (*stat).base_info[i].size(); j++) {
-                    for (int k = 0; k < (*stat).base_info[i][j].size(); k++) {
-                        (*stat).base_info[i][j][k] += local_counter.base_info[i][j][k];
-                    }
-                    for (int k = 0; k < (*stat).base_quality_info[i][j].size(); k++) {
-                        (*stat).base_quality_info[2 * i][j][k] += local_counter.base_quality_info[2 * i][j][k];
-                        (*stat).base_quality_info[2 * i + 1][j][k] += local_counter.base_quality_info[2 * i + 1][j][k];
-                    }
-                }
-            }
+            stat -> add(local_counter);
             mutex.unlock();
         }
-        else if (infiles.size() == 2) {
-            std::ifstream infq1(infiles[0].string(), std::ios_base::in | std::ios_base::binary);
-            std::ifstream infq2(infiles[1].string(), std::ios_base::in | std::ios_base::binary);
-            boost::iostreams::filtering_istream infq1_decompressor;
-            boost::iostreams::filtering_istream infq2_decompressor;
-            infq1_decompressor.push(boost::iostreams::gzip_decompressor());
-            infq2_decompressor.push(boost::iostreams::gzip_decompressor());
-            infq1_decompressor.push(infq1);
-            infq2_decompressor.push(infq2);
-
-            std::ofstream clean_outfq1((tmp_dir / clean_outfiles[0].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary); 
-            std::ofstream clean_outfq2((tmp_dir / clean_outfiles[1].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary); 
-            boost::iostreams::filtering_ostream clean_outfq1_compressor;
-            boost::iostreams::filtering_ostream clean_outfq2_compressor;
-            clean_outfq1_compressor.push(boost::iostreams::gzip_compressor());
-            clean_outfq2_compressor.push(boost::iostreams::gzip_compressor());
-            clean_outfq1_compressor.push(clean_outfq1);
-            clean_outfq2_compressor.push(clean_outfq2);
-
-            std::ofstream dropped_outfq1((tmp_dir / dropped_outfiles[0].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary);
-            std::ofstream dropped_outfq2((tmp_dir / dropped_outfiles[1].filename()).string() + "." + std::to_string(thread) + ".tmp", std::ios_base::out | std::ios_base::binary);
-            boost::iostreams::filtering_ostream dropped_outfq1_compressor;
-            boost::iostreams::filtering_ostream dropped_outfq2_compressor;
-            dropped_outfq1_compressor.push(boost::iostreams::gzip_compressor());
-            dropped_outfq2_compressor.push(boost::iostreams::gzip_compressor());
-            dropped_outfq1_compressor.push(dropped_outfq1);
-            dropped_outfq2_compressor.push(dropped_outfq2);
-            
+        else if (n_end == 2) {
             statistic local_counter(2, max_read_len);
-            unsigned int step_counter = 0;
-            int* base_info1;
-            int* base_info2;
-            int* base_quality_info1;
-            int* base_quality_info2;
-            int* clean_base_info1;
-            int* clean_base_info2;
-            int* clean_base_quality_info1;
-            int* clean_base_quality_info2;
-            std::string read_id_line1, read_line1, plus_line1, quality_line1;
-            std::string read_id_line2, read_line2, plus_line2, quality_line2;
+            int* base_info1 = new int[max_read_len + 1];
+            int* base_info2 = new int[max_read_len + 1];
+            int* base_quality_info1 = new int[max_read_len + 1];
+            int* base_quality_info2 = new int[max_read_len + 1];
+            int* clean_base_quality_info1 = new int[max_read_len + 1];
+            int* clean_base_quality_info2 = new int[max_read_len + 1];
+            read_summary summary1;
+            read_summary summary2;
             bool is_filtered1;
             bool is_filtered2;
             bool is_pair_filtered;
+            int overlap_min_len = param_int[5 + n_end * 2];
+            bool is_overlap_corrected = param_int[6 + n_end * 2];
+            adapter_trimmer::overlap_analyzer overlaps(overlap_min_len, param_float[3]);
+            adapter_trimmer::overlap pair_overlap;
 
-            for (int i = 0; i < stepsize * thread; i++) {
-                for (int j = 0; j < 4; j++) {
-                    getline(infq1_decompressor, read_id_line1);
-                    getline(infq2_decompressor, read_id_line2);
-                }
-            }
+            while (batches -> pop(thread, batch)) {
+                fastq_pipeline::record_batch clean_records1;
+                fastq_pipeline::record_batch clean_records2;
+                fastq_pipeline::record_batch dropped_records1;
+                fastq_pipeline::record_batch dropped_records2;
+                clean_records1.chunk = batch.chunks[0];
+                clean_records2.chunk = batch.chunks[1];
+                dropped_records1.chunk = batch.chunks[0];
+                dropped_records2.chunk = batch.chunks[1];
+                clean_records1.records.reserve(batch.reads[0].size());
+                clean_records2.records.reserve(batch.reads[0].size());
+                dropped_records1.records.reserve(batch.reads[0].size());
+                dropped_records2.records.reserve(batch.reads[0].size());
+#ifdef COUNT_ALLOCATIONS
+                unsigned long n_allocation_before = allocation_counter::count();
+#endif
 
-            while (getline(infq1_decompressor, read_id_line1) && getline(infq2_decompressor, read_id_line2)) {
-                getline(infq1_decompressor, read_line1);
-                getline(infq2_decompressor, read_line2);
-                getline(infq1_decompressor, plus_line1);
-                getline(infq2_decompressor, plus_line2);
-                getline(infq1_decompressor, quality_line1);
-                getline(infq2_decompressor, quality_line2);
+                for (int n = 0; n < batch.reads[0].size(); n++) {
+                    fastq_pipeline::line_view& read_id_line1 = batch.reads[0][n].read_id_line;
+                    fastq_pipeline::line_view& read_id_line2 = batch.reads[1][n].read_id_line;
+                    fastq_pipeline::line_view& read_line1 = batch.reads[0][n].read_line;
+                    fastq_pipeline::line_view& read_line2 = batch.reads[1][n].read_line;
+                    fastq_pipeline::line_view& quality_line1 = batch.reads[0][n].quality_line;
+                    fastq_pipeline::line_view& quality_line2 = batch.reads[1][n].quality_line;
 
-                if (read_line1.length() > max_read_len || read_line2.length() > max_read_len) {
-                    std::cout << log_title() << "ERROR -- There are reads whose length (" << std::max(read_line1.length(), read_line2.length()) << ") exceeds the maximum read length (" << max_read_len << ") so that segmentation fault may occur. Please set the argument of the parameter \'-maxReadLen/-l\' as one integer larger than or equal to " << std::max(read_line1.length(), read_line2.length()) << "." << std::endl;
-                    exit(1);
-                }
-
-                base_info1 = get_base_info(read_line1);
-                base_info2 = get_base_info(read_line2);
-                base_quality_info1 = get_base_quality_info(quality_line1, raw_quality_sys);
-                base_quality_info2 = get_base_quality_info(quality_line2, raw_quality_sys);
-                is_filtered1 = false;
-                is_filtered2 = false;
-                is_pair_filtered = false;
-
-                local_counter.read_len_info[0][base_info1[0] - 1]++;
-                local_counter.read_len_info[2][base_info2[0] - 1]++;
-                if (get_base_N_rate(read_line1) > max_base_N_rate) {
-                    local_counter.filtered_read_info[0][0]++;
-                    if (!is_filtered1) {
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered1 = true;
+                    size_t read_len = std::max(std::max(read_line1.length(), quality_line1.length()), std::max(read_line2.length(), quality_line2.length()));
+                    if (read_len > (size_t)max_read_len) {
+                        max_read_len = read_len;
+                        delete [] base_info1;
+                        delete [] base_info2;
+                        delete [] base_quality_info1;
+                        delete [] base_quality_info2;
+                        delete [] clean_base_quality_info1;
+                        delete [] clean_base_quality_info2;
+                        base_info1 = new int[max_read_len + 1];
+                        base_info2 = new int[max_read_len + 1];
+                        base_quality_info1 = new int[max_read_len + 1];
+                        base_quality_info2 = new int[max_read_len + 1];
+                        clean_base_quality_info1 = new int[max_read_len + 1];
+                        clean_base_quality_info2 = new int[max_read_len + 1];
+                        local_counter.grow(max_read_len);
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+
+                    evaluate_read(read_line1, quality_line1, raw_quality_sys, min_base_quality, base_info1, base_quality_info1, summary1);
+                    evaluate_read(read_line2, quality_line2, raw_quality_sys, min_base_quality, base_info2, base_quality_info2, summary2);
+                    is_filtered1 = false;
+                    is_filtered2 = false;
+                    is_pair_filtered = false;
+                    size_t quality_end1 = read_line1.size;
+                    size_t quality_end2 = read_line2.size;
+                    if (use_quality_trimming) {
+                        quality_end1 = trim_quality(base_info1, base_quality_info1, min_base_quality, window_size, window_quality, tail_quality, summary1);
+                        quality_end2 = trim_quality(base_info2, base_quality_info2, min_base_quality, window_size, window_quality, tail_quality, summary2);
                     }
-                }
-                if (get_base_N_rate(read_line2) > max_base_N_rate) {
-                    local_counter.filtered_read_info[1][0]++;
-                    if (!is_filtered2) {
-                        local_counter.filtered_read_info[1][4]++;
-                        is_filtered2 = true;
+
+                    local_counter.read_len_info[0][base_info1[0] - 1]++;
+                    local_counter.read_len_info[2][base_info2[0] - 1]++;
+                    if (summary1.base_N_rate() > max_base_N_rate) {
+                        local_counter.filtered_read_info[0][0]++;
+                        if (!is_filtered1) {
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered1 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+                    if (summary2.base_N_rate() > max_base_N_rate) {
+                        local_counter.filtered_read_info[1][0]++;
+                        if (!is_filtered2) {
+                            local_counter.filtered_read_info[1][4]++;
+                            is_filtered2 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                }
 
-                if (get_average_quality(quality_line1, raw_quality_sys) < min_ave_quality) {
-                    local_counter.filtered_read_info[0][1]++;
-                    if (!is_filtered1) {
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered1 = true;
+                    if (summary1.average_quality() < min_ave_quality) {
+                        local_counter.filtered_read_info[0][1]++;
+                        if (!is_filtered1) {
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered1 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+                    if (summary2.average_quality() < min_ave_quality) {
+                        local_counter.filtered_read_info[1][1]++;
+                        if (!is_filtered2) {
+                            local_counter.filtered_read_info[1][4]++;
+                            is_filtered2 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                }
-                if (get_average_quality(quality_line2, raw_quality_sys) < min_ave_quality) {
-                    local_counter.filtered_read_info[1][1]++;
-                    if (!is_filtered2) {
-                        local_counter.filtered_read_info[1][4]++;
-                        is_filtered2 = true;
+
+                    if (summary1.low_quality_rate() > max_low_quality_rate) {
+                        local_counter.filtered_read_info[0][2]++;
+                        if (!is_filtered1) {
+                            local_counter.filtered_read_info[0][4]++;
+                            is_filtered1 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+                    if (summary2.low_quality_rate() > max_low_quality_rate) {
+                        local_counter.filtered_read_info[1][2]++;
+                        if (!is_filtered2) {
+                            local_counter.filtered_read_info[1][4]++;
+                            is_filtered2 = true;
+                        }
+                        if (!is_pair_filtered) {
+                            local_counter.n_filtered++;
+                            is_pair_filtered = true;
+                        }
                     }
-                }
-
-                if (get_low_quality_rate(quality_line1, raw_quality_sys, min_base_quality) > max_low_quality_rate) {
-                    local_counter.filtered_read_info[0][2]++;
-                    if (!is_filtered1) {
-                        local_counter.filtered_read_info[0][4]++;
-                        is_filtered1 = true;
+                    bool is_adapter_listed1 = false;
+                    bool is_adapter_listed2 = false;
+                    if (adapter_read_id_lists.size() != 0) {
+                        if (adapter_read_id_lists[0].contains(read_id_line1.data + 1, read_id_line1.size - 1)) {
+                            is_adapter_listed1 = true;
+                            local_counter.filtered_read_info[0][3]++;
+                            if (!is_filtered1) {
+                                local_counter.filtered_read_info[0][4]++;
+                                is_filtered1 = true;
+                            }
+                            if (!is_pair_filtered) {
+                                local_counter.n_filtered++;
+                                is_pair_filtered = true;
+                            }
+                        }
+                        if (adapter_read_id_lists[1].contains(read_id_line2.data + 1, read_id_line2.size - 1)) {
+                            is_adapter_listed2 = true;
+                            local_counter.filtered_read_info[1][3]++;
+                            if (!is_filtered2) {
+                                local_counter.filtered_read_info[1][4]++;
+                                is_filtered2 = true;
+                            }
+                            if (!is_pair_filtered) {
+                                local_counter.n_filtered++;
+                                is_pair_filtered = true;
+                            }
+                        }
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+                    size_t adapter_start1 = read_line1.size;
+                    size_t adapter_start2 = read_line2.size;
+                    if (!adapters -> empty()) {
+                        adapter_start1 = adapters -> find(read_line1.data, read_line1.size);
+                        adapter_start2 = adapters -> find(read_line2.data, read_line2.size);
                     }
-                }
-                if (get_low_quality_rate(quality_line2, raw_quality_sys, min_base_quality) > max_low_quality_rate) {
-                    local_counter.filtered_read_info[1][2]++;
-                    if (!is_filtered2) {
-                        local_counter.filtered_read_info[1][4]++;
-                        is_filtered2 = true;
+                    // the mates read through into the adapter when the insert is shorter
+                    pair_overlap.length = 0;
+                    if (overlap_min_len > 0) {
+                        pair_overlap = overlaps.find(read_line1.data, read_line1.size, read_line2.data, read_line2.size);
+                        if (pair_overlap.length > 0) {
+                            adapter_start1 = std::min(adapter_start1, pair_overlap.insert_size);
+                            adapter_start2 = std::min(adapter_start2, pair_overlap.insert_size);
+                        }
                     }
-                    if (!is_pair_filtered) {
-                        local_counter.n_filtered++;
-                        is_pair_filtered = true;
+                    if (adapter_start1 < read_line1.size) {
+                        if (!is_adapter_listed1) {
+                            local_counter.filtered_read_info[0][3]++;
+                        }
+                        if (adapter_start1 < min_keep_len[0]) {
+                            if (!is_filtered1) {
+                                local_counter.filtered_read_info[0][4]++;
+                                is_filtered1 = true;
+                            }
+                            if (!is_pair_filtered) {
+                                local_counter.n_filtered++;
+                                is_pair_filtered = true;
+                            }
+                        }
                     }
-                }
-                if (adapter_read_id_lists.size() != 0) {
-                    std::string s1 = read_id_line1.substr(1, read_id_line1.size() - 1);
-                    std::string s2 = read_id_line2.substr(1, read_id_line2.size() - 1);
-                    if (adapter_read_id_lists[0].count(s1) > 0) {
-                        local_counter.filtered_read_info[0][3]++;
+                    if (adapter_start2 < read_line2.size) {
+                        if (!is_adapter_listed2) {
+                            local_counter.filtered_read_info[1][3]++;
+                        }
+                        if (adapter_start2 < min_keep_len[1]) {
+                            if (!is_filtered2) {
+                                local_counter.filtered_read_info[1][4]++;
+                                is_filtered2 = true;
+                            }
+                            if (!is_pair_filtered) {
+                                local_counter.n_filtered++;
+                                is_pair_filtered = true;
+                            }
+                        }
+                    }
+                    if (quality_end1 < read_line1.size && quality_end1 < min_keep_len[0]) {
+                        local_counter.filtered_read_info[0][2]++;
                         if (!is_filtered1) {
                             local_counter.filtered_read_info[0][4]++;
                             is_filtered1 = true;
@@ -547,8 +1195,8 @@ namespace fastq_filter {
                             is_pair_filtered = true;
                         }
                     }
-                    if (adapter_read_id_lists[1].count(s2) > 0) {
-                        local_counter.filtered_read_info[1][3]++;
+                    if (quality_end2 < read_line2.size && quality_end2 < min_keep_len[1]) {
+                        local_counter.filtered_read_info[1][2]++;
                         if (!is_filtered2) {
                             local_counter.filtered_read_info[1][4]++;
                             is_filtered2 = true;
@@ -558,156 +1206,331 @@ namespace fastq_filter {
                             is_pair_filtered = true;
                         }
                     }
-                }
 
-                local_counter.n_total++;
-                for (int i = 1; i < base_info1[0] + 1; i++) {
-                    local_counter.base_info[0][i - 1][base_info1[i]]++;
-                    local_counter.base_quality_info[0][i - 1][base_quality_info1[i]]++;
-                }
-                for (int i = 1; i < base_info2[0] + 1; i++) {
-                    local_counter.base_info[1][i - 1][base_info2[i]]++;
-                    local_counter.base_quality_info[2][i - 1][base_quality_info2[i]]++;
-                }
-                // if (verbose && counter[0] % 50000 == 0) {
-                //     std::cout << log_title() << "INFO " 
-                //         << std::fixed
-                //         << std::setw(12) << std::setprecision(6) << counter[0] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[1] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[1] * 100.0 / counter[0] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[2] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[3] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[4] << " | "
-                //         << std::setw(12) << std::setprecision(6) << counter[5] << " | "
-                //         << std::endl;
-                // }
-                // mutex.unlock();
-
-                if (!is_pair_filtered) {
-                    local_counter.n_clean++;
-                    trim_read(read_line1, trim_crit[0], trim_crit[1], min_read_len);
-                    trim_read(read_line2, trim_crit[2], trim_crit[3], min_read_len);
-                    trim_read(quality_line1, trim_crit[0], trim_crit[1], min_read_len);
-                    trim_read(quality_line2, trim_crit[2], trim_crit[3], min_read_len);
-                    clean_base_info1 = get_base_info(read_line1);
-                    clean_base_info2 = get_base_info(read_line2);
-                    local_counter.read_len_info[1][clean_base_info1[0] - 1]++;
-                    local_counter.read_len_info[3][clean_base_info2[0] - 1]++;
-                    if (raw_quality_sys != clean_quality_sys) {
-                        quality_system::quality_system_convert(quality_line1, raw_quality_sys, clean_quality_sys);
-                        quality_system::quality_system_convert(quality_line2, raw_quality_sys, clean_quality_sys);
-                    }
-                    clean_base_quality_info1 = get_base_quality_info(quality_line1, clean_quality_sys);
-                    clean_base_quality_info2 = get_base_quality_info(quality_line2, clean_quality_sys);
-                    for (int i = 1; i < clean_base_quality_info1[0] + 1; i++) {
-                        local_counter.base_info[0][i - 1][clean_base_info1[i] + 5]++;
-                        local_counter.base_quality_info[1][i - 1][clean_base_quality_info1[i]]++;
-                    }
-                    for (int i = 1; i < clean_base_quality_info2[0] + 1; i++) {
-                        local_counter.base_info[1][i - 1][clean_base_info2[i] + 5]++;
-                        local_counter.base_quality_info[3][i - 1][clean_base_quality_info2[i]]++;
-                    }
-                    clean_outfq1_compressor << read_id_line1 << std::endl
-                        << read_line1 << std::endl
-                        << plus_line1 << std::endl
-                        << quality_line1 << std::endl;
-                    clean_outfq2_compressor << read_id_line2 << std::endl
-                        << read_line2 << std::endl
-                        << plus_line2 << std::endl
-                        << quality_line2 << std::endl;
-                    delete [] clean_base_info1;
-                    delete [] clean_base_info2;
-                    delete [] clean_base_quality_info1;
-                    delete [] clean_base_quality_info2;
-                }
-                else {
-                    if (raw_quality_sys != clean_quality_sys) {
-                        quality_system::quality_system_convert(quality_line1, raw_quality_sys, clean_quality_sys);
-                        quality_system::quality_system_convert(quality_line2, raw_quality_sys, clean_quality_sys);
-                    }
-                    dropped_outfq1_compressor << read_id_line1 << std::endl
-                        << read_line1 << std::endl
-                        << plus_line1 << std::endl
-                        << quality_line1 << std::endl;
-                    dropped_outfq2_compressor << read_id_line2 << std::endl
-                        << read_line2 << std::endl
-                        << plus_line2 << std::endl
-                        << quality_line2 << std::endl;
-                }
-                delete [] base_info1;
-                delete [] base_info2;
-                delete [] base_quality_info1;
-                delete [] base_quality_info2;
+                    local_counter.n_total++;
+                    for (int i = 1; i < base_info1[0] + 1; i++) {
+                        local_counter.base_info(0, i - 1, base_info1[i])++;
+                        local_counter.base_quality_info(0, i - 1, quality_symbol(base_quality_info1[i]))++;
+                    }
+                    for (int i = 1; i < base_info2[0] + 1; i++) {
+                        local_counter.base_info(1, i - 1, base_info2[i])++;
+                        local_counter.base_quality_info(2, i - 1, quality_symbol(base_quality_info2[i]))++;
+                    }
 
-                step_counter++;
-                if (step_counter % stepsize == 0) {
-                    for (int i = 0; i < stepsize * (n_thread - 1); i++) {
-                        for (int j = 0; j < 4; j++) {
-                            getline(infq1_decompressor, read_id_line1);
-                            getline(infq2_decompressor, read_id_line2);
+                    if (!is_pair_filtered) {
+                        local_counter.n_clean++;
+                        const char* read_begin1 = read_line1.data;
+                        const char* read_begin2 = read_line2.data;
+                        if (pair_overlap.length > 0 && is_overlap_corrected) {
+                            // the clean bases are counted from the corrected reads
+                            if (overlaps.correct(read_line1.data, quality_line1.data, std::min(read_line1.size, quality_line1.size),
+                                        read_line2.data, quality_line2.data, std::min(read_line2.size, quality_line2.size), pair_overlap) > 0) {
+                                read_kernels::scan_bases(read_line1.data, read_line1.size, base_info1 + 1);
+                                read_kernels::scan_bases(read_line2.data, read_line2.size, base_info2 + 1);
+                            }
+                        }
+                        size_t keep_len1 = std::min(adapter_start1, quality_end1);
+                        size_t keep_len2 = std::min(adapter_start2, quality_end2);
+                        if (keep_len1 < read_line1.size) {
+                            cut_read(read_line1, quality_line1, keep_len1);
+                            batch.reads[0][n].is_intact = false;
+                        }
+                        if (keep_len2 < read_line2.size) {
+                            cut_read(read_line2, quality_line2, keep_len2);
+                            batch.reads[1][n].is_intact = false;
                         }
+                        bool is_read1_trimmed = trim_read(read_line1, trim_crit[0], trim_crit[1], min_read_len);
+                        bool is_read2_trimmed = trim_read(read_line2, trim_crit[2], trim_crit[3], min_read_len);
+                        bool is_quality1_trimmed = trim_read(quality_line1, trim_crit[0], trim_crit[1], min_read_len);
+                        bool is_quality2_trimmed = trim_read(quality_line2, trim_crit[2], trim_crit[3], min_read_len);
+                        if (is_read1_trimmed || is_quality1_trimmed) {
+                            batch.reads[0][n].is_intact = false;
+                        }
+                        if (is_read2_trimmed || is_quality2_trimmed) {
+                            batch.reads[1][n].is_intact = false;
+                        }
+                        int left_trim1 = read_line1.data - read_begin1;
+                        int left_trim2 = read_line2.data - read_begin2;
+                        local_counter.read_len_info[1][read_line1.length() - 1]++;
+                        local_counter.read_len_info[3][read_line2.length() - 1]++;
+                        if (raw_quality_sys != clean_quality_sys) {
+                            quality_system::quality_system_convert(quality_line1.data, quality_line1.size, raw_quality_sys, clean_quality_sys);
+                            quality_system::quality_system_convert(quality_line2.data, quality_line2.size, raw_quality_sys, clean_quality_sys);
+                        }
+                        get_base_quality_info(quality_line1, clean_quality_sys, clean_base_quality_info1);
+                        get_base_quality_info(quality_line2, clean_quality_sys, clean_base_quality_info2);
+                        for (int i = 1; i < clean_base_quality_info1[0] + 1; i++) {
+                            local_counter.base_info(0, i - 1, base_info1[left_trim1 + i] + 5)++;
+                            local_counter.base_quality_info(1, i - 1, quality_symbol(clean_base_quality_info1[i]))++;
+                        }
+                        for (int i = 1; i < clean_base_quality_info2[0] + 1; i++) {
+                            local_counter.base_info(1, i - 1, base_info2[left_trim2 + i] + 5)++;
+                            local_counter.base_quality_info(3, i - 1, quality_symbol(clean_base_quality_info2[i]))++;
+                        }
+                        clean_records1.records.push_back(batch.reads[0][n]);
+                        clean_records2.records.push_back(batch.reads[1][n]);
                     }
+                    else {
+                        if (raw_quality_sys != clean_quality_sys) {
+                            quality_system::quality_system_convert(quality_line1.data, quality_line1.size, raw_quality_sys, clean_quality_sys);
+                            quality_system::quality_system_convert(quality_line2.data, quality_line2.size, raw_quality_sys, clean_quality_sys);
+                        }
+                        dropped_records1.records.push_back(batch.reads[0][n]);
+                        dropped_records2.records.push_back(batch.reads[1][n]);
+                    }
+                }
+#ifdef COUNT_ALLOCATIONS
+                if (n_batch++ > 0) {
+                    n_read_allocation += allocation_counter::count() - n_allocation_before;
                 }
+#endif
+
+                clean_queues[0] -> push(batch.serial, std::move(clean_records1));
+                clean_queues[1] -> push(batch.serial, std::move(clean_records2));
+                dropped_queues[0] -> push(batch.serial, std::move(dropped_records1));
+                dropped_queues[1] -> push(batch.serial, std::move(dropped_records2));
             }
-            close(infq1_decompressor, std::ios_base::in);
-            close(infq2_decompressor, std::ios_base::in);
-            close(clean_outfq1_compressor, std::ios_base::out);
-            close(clean_outfq2_compressor, std::ios_base::out);
-            close(dropped_outfq1_compressor, std::ios_base::out);
-            close(dropped_outfq2_compressor, std::ios_base::out);
+            delete [] base_info1;
+            delete [] base_info2;
+            delete [] base_quality_info1;
+            delete [] base_quality_info2;
+            delete [] clean_base_quality_info1;
+            delete [] clean_base_quality_info2;
 
             mutex.lock();
-            (*stat).n_filtered += local_counter.n_filtered;
-            (*stat).n_total += local_counter.n_total;
-            (*stat).n_clean += local_counter.n_clean;
-            for (int i = 0; i < infiles.size(); i++) {
-                for (int j = 0; j < (*stat).read_len_info[i].size(); j++) {
-                    (*stat).read_len_info[2 * i][j] += local_counter.read_len_info[2 * i][j];
-                    (*stat).read_len_info[2 * i + 1][j] += local_counter.read_len_info[2 * i + 1][j];
+            stat -> add(local_counter);
+            mutex.unlock();
+        }
+#ifdef COUNT_ALLOCATIONS
+        mutex.lock();
+        std::cout << log_title() << "INFO -- Thread " << thread << " made " << n_read_allocation
+            << " heap allocations filtering reads after its first batch." << std::endl;
+        mutex.unlock();
+#endif
+        delete [] trim_crit;
+    }
+
+    // appends a record, or a run of intact records, and its final newline
+    static void append_line(std::string& buffer, const char* begin, const char* end) {
+        buffer.append(begin, end - begin).push_back('\n');
+    }
+
+    static void append_record(std::string& buffer, const fastq_pipeline::fastq_record& r) {
+        if (r.is_intact) {
+            append_line(buffer, r.read_id_line.data, r.quality_line.data + r.quality_line.size);
+            return;
+        }
+        append_line(buffer, r.read_id_line.data, r.read_id_line.data + r.read_id_line.size);
+        append_line(buffer, r.read_line.data, r.read_line.data + r.read_line.size);
+        append_line(buffer, r.plus_line.data, r.plus_line.data + r.plus_line.size);
+        append_line(buffer, r.quality_line.data, r.quality_line.data + r.quality_line.size);
+    }
+
+    void writer(std::vector<fastq_pipeline::record_queue*> queues,
+            boost::filesystem::path& outfile,
+            boost::filesystem::path& tmp_dir,
+            block_compressor::compression_pool* pool,
+            int compress_level,
+            block_compressor::block_format format,
+            size_t write_buffer_size,
+            bool is_flushed_per_batch) {
+        // batches come in input order and go straight to the output, unless it
+        // is staged in a tmp directory; the .gzi index always sits next to the
+        // final output, its offsets hold after merge
+        bool is_stdout = outfile.string() == "-";
+        std::string out_filename = (tmp_dir.empty() || is_stdout) ? outfile.string() : (tmp_dir / outfile.filename()).string() + ".tmp";
+        std::string index_filename = (format == block_compressor::BGZF && !is_stdout) ? outfile.string() + ".gzi" : "";
+        block_compressor::block_sink outfq_compressor(out_filename, pool, compress_level, format, index_filename);
+
+        // records are assembled in one buffer that goes to the compressor in a
+        // single write once it holds write_buffer_size bytes
+        std::string buffer;
+        buffer.reserve(write_buffer_size + (1 << 16));
+        fastq_pipeline::record_batch batch;
+        fastq_pipeline::record_batch mate_batch;
+        while (queues[0] -> pop(batch)) {
+            // both ends come in batches of the same pairs, anything else
+            // would leave the output short of reads
+            if (queues.size() == 2) {
+                if (!queues[1] -> pop(mate_batch) || mate_batch.records.size() != batch.records.size()) {
+                    throw std::runtime_error("the batches of read 1 and read 2 do not pair up");
                 }
-                for (int j = 0; j < (*stat).filtered_read_info[i].size(); j++) {
-                    (*stat).filtered_read_info[i][j] += local_counter.filtered_read_info[i][j];
+                for (size_t k = 0; k < batch.records.size(); k++) {
+                    append_record(buffer, batch.records[k]);
+                    append_record(buffer, mate_batch.records[k]);
+                    if (buffer.size() >= write_buffer_size) {
+                        outfq_compressor.write(buffer.data(), buffer.size());
+                        buffer.clear();
+                    }
                 }
-                for (int j = 0; j < (*stat).base_info[i].size(); j++) {
-                    for (int k = 0; k < (*stat).base_info[i][j].size(); k++) {
-                        (*stat).base_info[i][j][k] += local_counter.base_info[i][j][k];
+            }
+            // runs of intact records that follow each other in the chunk are
+            // copied from it as one span
+            const char* span_begin = NULL;
+            const char* span_end = NULL;
+            for (std::vector<fastq_pipeline::fastq_record>::const_iterator r = batch.records.begin(); queues.size() == 1 && r != batch.records.end(); r++) {
+                if (r -> is_intact) {
+                    const char* record_begin = r -> read_id_line.data;
+                    const char* record_end = r -> quality_line.data + r -> quality_line.size;
+                    if (span_end != NULL && record_begin == span_end + 1) {
+                        span_end = record_end;
+                        continue;
                     }
-                    for (int k = 0; k < (*stat).base_quality_info[i][j].size(); k++) {
-                        (*stat).base_quality_info[2 * i][j][k] += local_counter.base_quality_info[2 * i][j][k];
-                        (*stat).base_quality_info[2 * i + 1][j][k] += local_counter.base_quality_info[2 * i + 1][j][k];
+                    if (span_end != NULL) {
+                        append_line(buffer, span_begin, span_end);
                     }
+                    span_begin = record_begin;
+                    span_end = record_end;
+                }
+                else {
+                    if (span_end != NULL) {
+                        append_line(buffer, span_begin, span_end);
+                        span_end = NULL;
+                    }
+                    append_record(buffer, *r);
+                }
+                if (buffer.size() >= write_buffer_size) {
+                    outfq_compressor.write(buffer.data(), buffer.size());
+                    buffer.clear();
                 }
             }
-            mutex.unlock();
+            if (span_end != NULL) {
+                append_line(buffer, span_begin, span_end);
+            }
+            if (buffer.size() >= write_buffer_size || is_flushed_per_batch) {
+                outfq_compressor.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+            // a reader downstream gets every batch as soon as it is filtered
+            if (is_flushed_per_batch) {
+                outfq_compressor.flush();
+            }
         }
+        outfq_compressor.write(buffer.data(), buffer.size());
+        outfq_compressor.close();
     }
 
-    void merge_single(boost::filesystem::path& outfile, boost::filesystem::path& tmp_dir, int n_thread) {
-        boost::filesystem::remove(outfile);
-        std::ofstream out(outfile.string(), std::ios_base::out | std::ios_base::binary | std::ios_base::app);
-        
-        for (int j = 0; j < n_thread; j++) {
-            std::string tmp_filename = (tmp_dir / outfile.filename()).string() + "." + std::to_string(j) + ".tmp";
-            std::ifstream tmp_file(tmp_filename, std::ios_base::in | std::ios_base::binary);
+    void discarder(std::vector<fastq_pipeline::record_queue*> queues) {
+        // the workers fill the queues in turn, so they are emptied in turn
+        fastq_pipeline::record_batch batch;
+        bool is_open = true;
+        while (is_open) {
+            is_open = false;
+            for (std::vector<fastq_pipeline::record_queue*>::iterator q = queues.begin(); q != queues.end(); q++) {
+                if ((*q) -> pop(batch)) {
+                    is_open = true;
+                }
+            }
+        }
+    }
 
-            out << tmp_file.rdbuf();
+    // copies size bytes from the current position of in to out, in the
+    // kernel with copy_file_range or sendfile where they work and through a
+    // buffer otherwise; both advance the file offsets so that any of them
+    // takes over from where the one before stopped
+    static bool copy_file_data(int in, int out, off_t size) {
+        off_t copied = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+        while (copied < size) {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, size - copied, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            copied += n;
+        }
+#endif
+#ifdef HAVE_SENDFILE
+        while (copied < size) {
+            ssize_t n = sendfile(out, in, NULL, size - copied);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            copied += n;
+        }
+#endif
+        std::vector<char> buffer(1 << 20);
+        while (copied < size) {
+            ssize_t n = read(in, buffer.data(), buffer.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            for (ssize_t written = 0; written < n; ) {
+                ssize_t m = write(out, buffer.data() + written, n - written);
+                if (m < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (m <= 0) {
+                    return false;
+                }
+                written += m;
+            }
+            copied += n;
+        }
+        return copied == size;
+    }
+
+    // Moves a staged output into place. On the same file system a rename
+    // does it, otherwise the file is cloned where the file systems share
+    // extents (reflinks on XFS and Btrfs) or its data copied into a
+    // preallocated destination. The tmp file is kept when that fails.
+    void merge_single(boost::filesystem::path& outfile, boost::filesystem::path& tmp_dir) {
+        boost::filesystem::remove(outfile);
+        std::string tmp_filename = (tmp_dir / outfile.filename()).string() + ".tmp";
+        if (rename(tmp_filename.c_str(), outfile.c_str()) == 0) {
+            return;
+        }
 
-            tmp_file.close();
+        int in = open(tmp_filename.c_str(), O_RDONLY);
+        int out = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        struct stat in_stat;
+        bool is_copied = in >= 0 && out >= 0 && fstat(in, &in_stat) == 0;
+        if (is_copied) {
+#ifdef FICLONE
+            is_copied = ioctl(out, FICLONE, in) == 0;
+#else
+            is_copied = false;
+#endif
+            if (!is_copied) {
+#ifdef HAVE_POSIX_FALLOCATE
+                posix_fallocate(out, 0, in_stat.st_size);
+#endif
+                is_copied = copy_file_data(in, out, in_stat.st_size);
+            }
+        }
+        if (in >= 0) {
+            close(in);
+        }
+        if (out >= 0 && close(out) != 0) {
+            is_copied = false;
+        }
 
+        if (is_copied) {
             boost::filesystem::remove(tmp_filename);
         }
-        
-        out.close();
+        else {
+            mutex.lock();
+            std::cout << log_title() << "ERROR -- Failed to move " << tmp_filename << " to "
+                << outfile.string() << ", it is left in place." << std::endl;
+            mutex.unlock();
+        }
     }
 
     void merge(std::vector<boost::filesystem::path>& clean_outfiles,
             std::vector<boost::filesystem::path>& dropped_outfiles,
-            boost::filesystem::path& tmp_dir,
-            int n_thread) {
+            boost::filesystem::path& tmp_dir) {
         boost::thread t[clean_outfiles.size() * 2];
         for (int i = 0; i < clean_outfiles.size(); i++) {
-            t[2 * i] = boost::thread(merge_single, clean_outfiles[i], tmp_dir, n_thread);
-            t[2 * i + 1] = boost::thread(merge_single, dropped_outfiles[i], tmp_dir, n_thread);
+            t[2 * i] = boost::thread(merge_single, clean_outfiles[i], tmp_dir);
+            t[2 * i + 1] = boost::thread(merge_single, dropped_outfiles[i], tmp_dir);
         }
 
         for (int i = 0; i < clean_outfiles.size() * 2; i++) {
@@ -715,8 +1538,8 @@ namespace fastq_filter {
         }
     }
 
-    void write_statistic(statistic stat, boost::filesystem::path& out_dir) {
-        int n_end = stat.base_info.size();
+    void write_statistic(const statistic& stat, boost::filesystem::path& out_dir) {
+        int n_end = stat.base_info.n_end();
         // filtered info
         std::ofstream filtered_read_info_file(out_dir.string() + "/Statistics_of_reads.txt", std::ios_base::out);
         if (n_end == 1) {
@@ -818,23 +1641,23 @@ namespace fastq_filter {
 
             // base info
             base_info_file << "Len_Pos\tn_raw\t%_raw\tA_raw\t%_raw\tC_raw\t%_raw\tG_raw\t%_raw\tT_raw\t%_raw\tN_raw\t%_raw\tn_raw\t%_raw\tA_clean\t%_clean\tC_clean\t%_clean\tG_clean\t%_clean\tT_clean\t%_clean\tN_clean\t%_clean" << std::endl;
-            std::vector<unsigned long> sum_by_base(stat.base_info[i][0].size());
+            std::vector<unsigned long> sum_by_base(stat.base_info.n_symbol());
             // unsigned long raw_read_len_sum = std::accumulate(stat.read_len_info[2 * i].begin(), stat.read_len_info[2 * i].end(), 0);
             // unsigned long clean_read_len_sum = std::accumulate(stat.read_len_info[2 * i + 1].begin(), stat.read_len_info[2 * i + 1].end(), 0);
             unsigned long raw_base_sum = 0;
             unsigned long clean_base_sum = 0;
-            for (int j = 0; j < stat.base_info[i].size(); j++) {
+            for (int j = 0; j < stat.base_info.n_pos(); j++) {
                 base_info_file << std::fixed << std::setprecision(2) << j + 1 << '\t' << stat.read_len_info[2 * i][j] << '\t' << stat.read_len_info[2 * i][j] * 100.0 / stat.n_total;
-                for (int k = 0; k < stat.base_info[i][j].size() / 2; k++) {
-                    base_info_file << '\t' << std::fixed << std::setprecision(2) << stat.base_info[i][j][k] << '\t' << stat.base_info[i][j][k] * 100.0 / stat.n_total;
-                    sum_by_base[k] += stat.base_info[i][j][k];
-                    raw_base_sum += stat.base_info[i][j][k];
+                for (int k = 0; k < stat.base_info.n_symbol() / 2; k++) {
+                    base_info_file << '\t' << std::fixed << std::setprecision(2) << stat.base_info(i, j, k) << '\t' << stat.base_info(i, j, k) * 100.0 / stat.n_total;
+                    sum_by_base[k] += stat.base_info(i, j, k);
+                    raw_base_sum += stat.base_info(i, j, k);
                 }
                 base_info_file << std::fixed << std::setprecision(2) << '\t' << stat.read_len_info[2 * i + 1][j] << '\t' << stat.read_len_info[2 * i + 1][j] * 100.0 / stat.n_clean;
-                for (int k = stat.base_info[i][j].size() / 2; k < stat.base_info[i][j].size(); k++) {
-                    base_info_file << '\t' << std::fixed << std::setprecision(2) << stat.base_info[i][j][k] << '\t' << stat.base_info[i][j][k] * 100.0 / stat.n_clean;
-                    sum_by_base[k] += stat.base_info[i][j][k];
-                    clean_base_sum += stat.base_info[i][j][k];
+                for (int k = stat.base_info.n_symbol() / 2; k < stat.base_info.n_symbol(); k++) {
+                    base_info_file << '\t' << std::fixed << std::setprecision(2) << stat.base_info(i, j, k) << '\t' << stat.base_info(i, j, k) * 100.0 / stat.n_clean;
+                    sum_by_base[k] += stat.base_info(i, j, k);
+                    clean_base_sum += stat.base_info(i, j, k);
                 }
                 base_info_file << std::endl;
             }
@@ -850,12 +1673,12 @@ namespace fastq_filter {
 
             // base quality
             raw_base_quality_info_file << "POS";
-            for (int j = 0; j < stat.base_quality_info[2 * i][0].size(); j++) {
+            for (int j = 0; j < stat.base_quality_info.n_symbol(); j++) {
                 raw_base_quality_info_file << "\tQ" << j;
             }
             raw_base_quality_info_file << "\tMean\t10-quantile\t25-quantile\tMedian\t75-quantile\t90-quantile" << std::endl;
-            std::vector<unsigned long> sum_by_quality(stat.base_quality_info[i][0].size());
-            for (int j = 0; j < stat.base_quality_info[2 * i].size(); j++) {
+            std::vector<unsigned long> sum_by_quality(stat.base_quality_info.n_symbol());
+            for (int j = 0; j < stat.base_quality_info.n_pos(); j++) {
                 raw_base_quality_info_file << j + 1;
                 unsigned long quality_sum = 0;
                 unsigned long count = 0;
@@ -864,13 +1687,13 @@ namespace fastq_filter {
                 int median = 0;
                 int quantile_75 = 0;
                 int quantile_90 = 0;
-                for (int k = 0; k < stat.base_quality_info[2 * i][j].size(); k++) {
-                    raw_base_quality_info_file << '\t' << stat.base_quality_info[2 * i][j][k];
-                    quality_sum += k * stat.base_quality_info[2 * i][j][k];
-                    sum_by_quality[k] += stat.base_quality_info[2 * i][j][k];
-                    count += stat.base_quality_info[2 * i][j][k];
+                for (int k = 0; k < stat.base_quality_info.n_symbol(); k++) {
+                    raw_base_quality_info_file << '\t' << stat.base_quality_info(2 * i, j, k);
+                    quality_sum += k * stat.base_quality_info(2 * i, j, k);
+                    sum_by_quality[k] += stat.base_quality_info(2 * i, j, k);
+                    count += stat.base_quality_info(2 * i, j, k);
                     if (quantile_10 == 0 && count > stat.n_total * 0.1) {
-                        if (count - stat.base_quality_info[2 * i][j][k] < stat.n_total * 0.1) {
+                        if (count - stat.base_quality_info(2 * i, j, k) < stat.n_total * 0.1) {
                             quantile_10 = k;
                         }
                         else {
@@ -878,7 +1701,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_25 == 0 && count > stat.n_total * 0.25) {
-                        if (count - stat.base_quality_info[2 * i][j][k] < stat.n_total * 0.25) {
+                        if (count - stat.base_quality_info(2 * i, j, k) < stat.n_total * 0.25) {
                             quantile_25 = k;
                         }
                         else {
@@ -886,7 +1709,7 @@ namespace fastq_filter {
                         }
                     }
                     if (median == 0 && count > stat.n_total * 0.5) {
-                        if (count - stat.base_quality_info[2 * i][j][k] < stat.n_total * 0.5) {
+                        if (count - stat.base_quality_info(2 * i, j, k) < stat.n_total * 0.5) {
                             median = k;
                         }
                         else {
@@ -894,7 +1717,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_75 == 0 && count > stat.n_total * 0.75) {
-                        if (count - stat.base_quality_info[2 * i][j][k] < stat.n_total * 0.75) {
+                        if (count - stat.base_quality_info(2 * i, j, k) < stat.n_total * 0.75) {
                             quantile_75 = k;
                         }
                         else {
@@ -902,7 +1725,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_90 == 0 && count > stat.n_total * 0.9) {
-                        if (count - stat.base_quality_info[2 * i][j][k] < stat.n_total * 0.9) {
+                        if (count - stat.base_quality_info(2 * i, j, k) < stat.n_total * 0.9) {
                             quantile_90 = k;
                         }
                         else {
@@ -931,12 +1754,12 @@ namespace fastq_filter {
             }
             raw_base_quality_info_file << std::endl;
             clean_base_quality_info_file << "POS";
-            for (int j = 0; j < stat.base_quality_info[2 * i + 1][0].size(); j++) {
+            for (int j = 0; j < stat.base_quality_info.n_symbol(); j++) {
                 clean_base_quality_info_file << "\tQ" << j;
             }
             clean_base_quality_info_file << "\tMean\t10-quantile\t25-quantile\tMedian\t75-quantile\t90-quantile" << std::endl;
-            sum_by_quality = std::vector<unsigned long>(stat.base_quality_info[2 * i + 1][0].size());
-            for (int j = 0; j < stat.base_quality_info[2 * i + 1].size(); j++) {
+            sum_by_quality = std::vector<unsigned long>(stat.base_quality_info.n_symbol());
+            for (int j = 0; j < stat.base_quality_info.n_pos(); j++) {
                 clean_base_quality_info_file << j + 1;
                 unsigned long quality_sum = 0;
                 unsigned long count = 0;
@@ -945,13 +1768,13 @@ namespace fastq_filter {
                 int median = 0;
                 int quantile_75 = 0;
                 int quantile_90 = 0;
-                for (int k = 0; k < stat.base_quality_info[2 * i + 1][j].size(); k++) {
-                    clean_base_quality_info_file << '\t' << stat.base_quality_info[2 * i + 1][j][k];
-                    quality_sum += k * stat.base_quality_info[2 * i + 1][j][k];
-                    sum_by_quality[k] += stat.base_quality_info[2 * i + 1][j][k];
-                    count += stat.base_quality_info[2 * i + 1][j][k];
+                for (int k = 0; k < stat.base_quality_info.n_symbol(); k++) {
+                    clean_base_quality_info_file << '\t' << stat.base_quality_info(2 * i + 1, j, k);
+                    quality_sum += k * stat.base_quality_info(2 * i + 1, j, k);
+                    sum_by_quality[k] += stat.base_quality_info(2 * i + 1, j, k);
+                    count += stat.base_quality_info(2 * i + 1, j, k);
                     if (quantile_10 == 0 && count > stat.n_clean * 0.1) {
-                        if (count - stat.base_quality_info[2 * i + 1][j][k] < stat.n_clean * 0.1) {
+                        if (count - stat.base_quality_info(2 * i + 1, j, k) < stat.n_clean * 0.1) {
                             quantile_10 = k;
                         }
                         else {
@@ -959,7 +1782,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_25 == 0 && count > stat.n_clean * 0.25) {
-                        if (count - stat.base_quality_info[2 * i + 1][j][k] < stat.n_clean * 0.25) {
+                        if (count - stat.base_quality_info(2 * i + 1, j, k) < stat.n_clean * 0.25) {
                             quantile_25 = k;
                         }
                         else {
@@ -967,7 +1790,7 @@ namespace fastq_filter {
                         }
                     }
                     if (median == 0 && count > stat.n_clean * 0.5) {
-                        if (count - stat.base_quality_info[2 * i + 1][j][k] < stat.n_clean * 0.5) {
+                        if (count - stat.base_quality_info(2 * i + 1, j, k) < stat.n_clean * 0.5) {
                             median = k;
                         }
                         else {
@@ -975,7 +1798,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_75 == 0 && count > stat.n_clean * 0.75) {
-                        if (count - stat.base_quality_info[2 * i + 1][j][k] < stat.n_clean * 0.75) {
+                        if (count - stat.base_quality_info(2 * i + 1, j, k) < stat.n_clean * 0.75) {
                             quantile_75 = k;
                         }
                         else {
@@ -983,7 +1806,7 @@ namespace fastq_filter {
                         }
                     }
                     if (quantile_90 == 0 && count > stat.n_clean * 0.9) {
-                        if (count - stat.base_quality_info[2 * i + 1][j][k] < stat.n_clean * 0.9) {
+                        if (count - stat.base_quality_info(2 * i + 1, j, k) < stat.n_clean * 0.9) {
                             quantile_90 = k;
                         }
                         else {
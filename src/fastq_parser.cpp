@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstring>
+#include <fastq_parser.hpp>
+
+namespace fastq_parser {
+    const size_t READ_SIZE = 1 << 16;
+
+    static void find_line_ends(const char* data, size_t begin, size_t end, std::vector<size_t>& line_ends) {
+        const char* p = data + begin;
+        const char* last = data + end;
+        while (p < last) {
+            const char* newline = (const char*)memchr(p, '\n', last - p);
+            if (newline == NULL) {
+                break;
+            }
+            line_ends.push_back(newline - data);
+            p = newline + 1;
+        }
+    }
+
+    // Builds records from groups of four lines. A last group with fewer
+    // lines gets empty views for the missing ones, as reading them with
+    // getline at the end of a file would.
+    static void make_records(char* data, const std::vector<size_t>& line_ends, size_t n_line, std::vector<fastq_pipeline::fastq_record>& records) {
+        size_t line_begin = 0;
+        for (size_t i = 0; i < n_line; i += 4) {
+            fastq_pipeline::line_view lines[4];
+            for (size_t j = 0; j < 4 && i + j < n_line; j++) {
+                lines[j] = fastq_pipeline::line_view(data + line_begin, line_ends[i + j] - line_begin);
+                line_begin = line_ends[i + j] + 1;
+            }
+            fastq_pipeline::fastq_record record;
+            record.read_id_line = lines[0];
+            record.read_line = lines[1];
+            record.plus_line = lines[2];
+            record.quality_line = lines[3];
+            record.is_intact = i + 4 <= n_line;
+            records.push_back(record);
+        }
+    }
+
+    void parse_chunk(std::string& chunk, std::vector<fastq_pipeline::fastq_record>& records) {
+        std::vector<size_t> line_ends;
+        find_line_ends(chunk.data(), 0, chunk.size(), line_ends);
+        make_records(&chunk[0], line_ends, line_ends.size(), records);
+    }
+
+    chunk_reader::chunk_reader(std::istream& in) : in(in), is_eof(false), bytes_per_record(0) {}
+
+    bool chunk_reader::read(size_t n, fastq_pipeline::chunk_ptr& chunk, std::vector<fastq_pipeline::fastq_record>& records) {
+        records.clear();
+        chunk = std::make_shared<std::string>();
+        chunk -> swap(carry);
+        size_t filled = chunk -> size();
+        // sized from the previous chunk so that it rarely has to grow
+        chunk -> resize(std::max(n * bytes_per_record + READ_SIZE, filled + READ_SIZE));
+
+        size_t n_line = 4 * n;
+        while (line_ends.size() < n_line && !is_eof) {
+            if (filled + READ_SIZE > chunk -> size()) {
+                chunk -> resize(2 * chunk -> size());
+            }
+            in.read(&(*chunk)[filled], READ_SIZE);
+            size_t n_read = in.gcount();
+            if (n_read == 0) {
+                is_eof = true;
+                break;
+            }
+            find_line_ends(chunk -> data(), filled, filled + n_read, line_ends);
+            filled += n_read;
+        }
+
+        size_t n_taken = std::min(n_line, line_ends.size());
+        size_t tail = (n_taken == 0) ? 0 : line_ends[n_taken - 1] + 1;
+        if (is_eof && n_taken < n_line && tail < filled) {
+            // the last line of the input has no newline, it ends with the data
+            line_ends.push_back(filled);
+            n_taken++;
+            tail = filled;
+        }
+        make_records(&(*chunk)[0], line_ends, n_taken, records);
+
+        // lines already found after the chunk stay known for the next one
+        carry.assign(chunk -> data() + tail, filled - tail);
+        line_ends.erase(line_ends.begin(), line_ends.begin() + n_taken);
+        for (std::vector<size_t>::iterator l = line_ends.begin(); l != line_ends.end(); l++) {
+            *l -= tail;
+        }
+        if (!records.empty()) {
+            bytes_per_record = tail / records.size() + 1;
+        }
+        return !records.empty();
+    }
+}
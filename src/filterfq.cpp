@@ -5,14 +5,17 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <iterator>
-#include <unordered_set>
 
 #include <command_options.hpp>
 #include <fastq_filter.hpp>
+#include <gzip_codec.hpp>
+#include <input_codec.hpp>
 #include <quality_system.hpp>
+#include <read_kernels.hpp>
 #include <version.hpp>
 
 // #define TESTING
@@ -35,8 +38,14 @@ int main(int argc, char* argv[]) {
         path tmp_dir;
         vector<path> raw_fq;
         vector<path> adapter;
+        vector<string> adapter_seq;
         const string quality_sys[5] = {"Sanger", "Solexa", "Illumina 1.3+", "Illumina 1.5+", "Illumina 1.8+"};
-        const int THREAD_BLOCK_SIZE = 500000;
+        const int BATCH_SIZE = 10000;
+        const unsigned long DETECTION_READS = 200000;
+        const int LOW_LATENCY_BATCH_SIZE = 1000;
+        const unsigned long LOW_LATENCY_DETECTION_READS = 10000;
+        const int LOW_LATENCY_WRITE_BUFFER_SIZE = 64;
+        const unsigned long CHECK_READS = 4000000;
         bool only_get_read_info;
         bool prefer_specified_raw_quality_sys;
         // bool verbose;
@@ -46,6 +55,15 @@ int main(int argc, char* argv[]) {
         float max_base_N_rate;
         float min_ave_quality;
         float max_low_quality_rate;
+        float adapter_error_rate;
+        int adapter_min_overlap;
+        bool use_overlap_trim;
+        bool use_overlap_correction;
+        int overlap_min_len;
+        float overlap_mismatch_rate;
+        int window_size;
+        float window_quality;
+        int tail_quality;
         vector<string> trim_string;
         int * trim_num;
         int min_read_len;
@@ -53,6 +71,13 @@ int main(int argc, char* argv[]) {
 
         // output variables
         int clean_quality_sys;
+        int compress_level;
+        int n_compress_thread;
+        int write_buffer_size;
+        string out_format_name;
+        bool use_bgzf;
+        bool use_adapter_cache;
+        bool use_low_latency;
         path out_dir;
         string out_basename;
         vector<path> clean_fq;
@@ -62,32 +87,49 @@ int main(int argc, char* argv[]) {
         generic.add_options()
             ("help,h", "produce help message")
             ("version,v", "print current version")
-            ("thread,t", value<int>(&n_thread) -> default_value(8), "specify the number of threads to use, maximum 8")
-            ("tmpDir,T", value<path>(&tmp_dir), "specify the directory to store temporary files, default as the same as \'outDir\'")
+            ("thread,t", value<int>(&n_thread) -> default_value(8), "specify the number of threads to use")
+            ("tmpDir,T", value<path>(&tmp_dir), "stage the output fastq(s) in this directory and move them to \'outDir\' at the end, by default they are written in place")
         ;
         
         options_description param("Input parameters & files", options_description::m_default_line_length * 1.5, options_description::m_default_line_length);
         param.add_options()
-            ("rawFastq,f", value< vector<path> >(&raw_fq) -> required() -> multitoken(), "raw fastq file(s) that need cleaned, required")
+            ("rawFastq,f", value< vector<path> >(&raw_fq) -> required() -> multitoken(), "raw fastq file(s) that need cleaned, \'-\' for stdin, required")
             ("adapter,a", value< vector<path> >(&adapter) -> multitoken(), "adapter file(s)")
+            ("adapterCache", bool_switch(&use_adapter_cache), "save the read ID index of each adapter file next to it as <adapter>.idx and map it from there in later runs")
+            ("adapterSeq", value< vector<string> >(&adapter_seq) -> multitoken(), "adapter sequence(s) or FASTA file(s) of them, reads are cut where one starts at their 3\' end")
+            ("adapterErrorRate", value<float>(&adapter_error_rate) -> default_value(0.1), "mismatches allowed per matched adapter base")
+            ("adapterMinOverlap", value<int>(&adapter_min_overlap) -> default_value(3), "minimum adapter bases matching at the end of a read")
+            ("overlapTrim", bool_switch(&use_overlap_trim), "cut paired reads to their insert where read 1 overlaps read 2 reverse complemented")
+            ("overlapCorrect", bool_switch(&use_overlap_correction), "also set mismatched bases in the overlap to the one of higher quality")
+            ("overlapMinLen", value<int>(&overlap_min_len) -> default_value(30), "minimum overlap of the mates")
+            ("overlapMismatchRate", value<float>(&overlap_mismatch_rate) -> default_value(0.1), "mismatches allowed per overlapping base")
             ("rawQualitySystem,s", value<int>(&raw_quality_sys), "specify quality system of raw fastq\n  0: Sanger\n  1: Solexa\n  2: Illumina 1.3+\n  3: Illumina 1.5+\n  4: Illumina 1.8+")
             ("preferRawQuality,p", bool_switch(&prefer_specified_raw_quality_sys), "indicate that user prefers the given quality system to process")
-            ("checkQualitySystem,c", bool_switch(&only_get_read_info), "only check quality system of the fastq file")
+            ("checkQualitySystem,c", bool_switch(&only_get_read_info), "only check quality system of the fastq files")
             // ("verbose,v", bool_switch(&verbose), "print filtering information")
             ("baseNrate,N", value<float>(&max_base_N_rate) -> default_value(0.05), "maximum rate of \'N\' base allowed along a read")
             ("averageQuality,Q", value<float>(&min_ave_quality) -> default_value(0), "minimum average quality allowed along a read")
             ("baseQuality,q", value<int>(&min_base_quality) -> default_value(5), "minimum quality per base allowed along a read")
             ("lowQualityRate,r", value<float>(&max_low_quality_rate) -> default_value(0.5), "maximum low quality rate along a read")
             ("trim,m", value< vector<string> >(&trim_string) -> multitoken(), "specify the number of bases that should be trimmed when filtering")
+            ("slidingWindow", value<int>(&window_size) -> default_value(0), "size of the window moved along a read, which is cut from the first window whose average quality is below \'windowQuality\', 0 to disable")
+            ("windowQuality", value<float>(&window_quality) -> default_value(20), "minimum average quality of a sliding window")
+            ("tailQuality", value<int>(&tail_quality) -> default_value(0), "quality threshold of BWA-style 3\' trimming, 0 to disable")
             ("minReadLen,l", value<int>(&min_read_len) -> default_value(90), "minimum read length in filtered fastq file")
-            ("maxReadLen,L", value<int>(&max_read_len) -> default_value(100), "maximum read length in the fastq file")
+            ("maxReadLen,L", value<int>(&max_read_len) -> default_value(100), "expected maximum read length in the fastq file, the statistics grow past it as needed")
         ;
 
         options_description output("Output parameters & files", options_description::m_default_line_length * 1.5, options_description::m_default_line_length);
         output.add_options()
             ("cleanQualitySystem,S", value<int>(&clean_quality_sys) -> default_value(4), "specify quality system of cleaned fastq, the same as rawQualitySystem")
             ("outDir,O", value<path>(&out_dir), "specify output directory")
-            ("outBasename,o", value<string>(&out_basename), "specify the basename for output file(s)")
+            ("outBasename,o", value<string>(&out_basename), "specify the basename for output file(s), \'-\' to write the cleaned reads to stdout, pairs interleaved")
+            ("outFormat", value<string>(&out_format_name) -> default_value("gzip"), "format of output fastq(s): gzip, bgzf, zstd or plain")
+            ("compressLevel", value<int>(&compress_level) -> default_value(6), "compression level of output fastq(s), 0-9 for gzip and 1-19 for zstd (3 when not given)")
+            ("bgzf", bool_switch(&use_bgzf), "write output fastq(s) in BGZF with a .gzi block index for each, the same as --outFormat bgzf")
+            ("compressThreads", value<int>(&n_compress_thread), "specify the number of threads compressing output fastq(s), default as the same as \'thread\'")
+            ("writeBufferSize", value<int>(&write_buffer_size) -> default_value(4096), "size in KB of the buffer each output fastq is assembled in before compression")
+            ("lowLatency", bool_switch(&use_low_latency), "pass reads on in small batches and flush the output after each, uncompressed to stdout and at gzip level 1 to files unless given")
             // ("cleanFastq,F", value< vector<path> >(&clean_fq) -> multitoken(), "cleaned fastq file name(s), not used if outDir or outBasename is specified")
             // ("droppedFastq,D", value< vector<path> >(&dropped_fq) -> multitoken(), "fastq file(s) containing reads that are filtered out")
         ;
@@ -108,82 +150,161 @@ int main(int argc, char* argv[]) {
             cout << version.str() << endl;
             return 0;
         }
+        // the cleaned reads go to stdout with -o -, outDir then only takes
+        // the statistics
+        bool is_stdout = vm.count("outBasename") && vm["outBasename"].as<string>() == "-";
         check_option_dependency(2, vm, "rawFastq", "outBasename", "outDir");
-        check_option_dependency(1, vm, "outBasename", "outDir");
+        if (!is_stdout) {
+            check_option_dependency(1, vm, "outBasename", "outDir");
+        }
         check_option_dependency(1, vm, "outDir", "outBasename");
         notify(vm);    
+
+        if (count(raw_fq.begin(), raw_fq.end(), path("-")) > 1) {
+            cerr << "error: stdin can only be read as one fastq" << endl;
+            return 1;
+        }
+        // stdout is kept for the reads, the log goes to stderr
+        if (is_stdout && !only_get_read_info) {
+            cout.rdbuf(cerr.rdbuf());
+        }
         
         for (vector<path>::iterator p = raw_fq.begin(); p != raw_fq.end(); p++) {
+            if (*p == "-") {
+                continue;
+            }
             try {
                 *p = canonical(*p);
             }
             catch (filesystem_error& e) {
+                // checking goes on with the other files and reports this one
+                if (only_get_read_info) {
+                    continue;
+                }
                 cerr << "error: No such file or directory: " << e.path1().string() << endl;
                 return 1;
             }
         }
 
         if (only_get_read_info) {
-            cout << log_title() << "Welcome to filterfq!" << endl
+            // stdout only gets one tab-separated line per file, the log goes
+            // to stderr
+            cerr << log_title() << "Welcome to filterfq!" << endl
                 << log_title() << "INFO -- Parameters: filterfq ";
             for (variables_map::iterator i = vm.begin(); i != vm.end(); i++) {
                 const variable_value& v = i -> second;
                 if (v.value().type() == typeid(bool) && v.as<bool>()) {
-                    cout << "--" << i -> first << " ";
+                    cerr << "--" << i -> first << " ";
+                }
+                else if (v.value().type() == typeid(int) && i -> first == "thread") {
+                    cerr << "--" << i -> first << " " << v.as<int>() << " ";
                 }
                 else if (v.value().type() == typeid(vector<path>)) {
                     string op = i -> first;
                     if (op == "rawFastq") {
-                        cout << "--" << op << " ";
+                        cerr << "--" << op << " ";
                         for (path p : raw_fq) {
-                            cout << p.string() << " ";
+                            cerr << p.string() << " ";
                         }
                     }
                 }
             }
-            cout << endl;
-            int* read_info = get_read_info(raw_fq[0]);
-            cout << log_title() << "INFO -- After checking " << ((read_info[3] < 4000000) ? read_info[3] : 4000000) << " reads, min quality code is \'" 
-                << (char)read_info[0] 
-                << "\' and max quality code is \'" 
-                << (char)read_info[1] 
-                << "\', the quality system is probably " 
-                << quality_sys[read_info[2]] 
-                << ". " 
-                << "The maximum length of scanned reads is " 
-                << read_info[4] 
-                << "." << endl;
+            cerr << endl;
+            int n_failed = 0;
+            cout << "#file\tquality_system\tname\tmin_code\tmax_code\treads_checked\tmax_read_len" << endl;
+            check_quality_systems(raw_fq, CHECK_READS, max(n_thread, 1), [&](const quality_check& result) {
+                if (result.quality_system < 0) {
+                    cerr << log_title() << "ERROR -- " << result.error << ": " << result.file.string() << endl;
+                    cout << result.file.string() << "\t-1\t" << result.error << "\t\t\t" << result.n_read << "\t" << result.max_read_len << endl;
+                    n_failed++;
+                    return;
+                }
+                cout << result.file.string() << "\t" << result.quality_system << "\t" << quality_sys[result.quality_system]
+                    << "\t" << result.min_quality << "\t" << result.max_quality
+                    << "\t" << result.n_read << "\t" << result.max_read_len << endl;
+            });
             ptime end_time = second_clock::local_time();
             time_duration dt = end_time - start_time;
-            cout << log_title() << "INFO -- Process finished successfully! "
+            if (n_failed > 0) {
+                cerr << log_title() << "ERROR -- " << n_failed << " of " << raw_fq.size() << " files could not be checked. "
+                    << dt.total_seconds() << " seconds elapsed." << endl;
+                return 1;
+            }
+            cerr << log_title() << "INFO -- Process finished successfully! "
                 << dt.total_seconds() << " seconds elapsed. Thank you for using filterfq!" << endl;
-            delete read_info;
             return 0;
         }
         
-        try {
-            out_dir = canonical(out_dir);
+        for (vector<path>::iterator p = raw_fq.begin(); p != raw_fq.end(); p++) {
+            input_codec::input_format format = input_codec::detect_format(p -> string());
+            if (!input_codec::is_supported(format)) {
+                cerr << "error: " << input_codec::format_name(format) << " input is not supported by this build: " << p -> string() << endl;
+                return 1;
+            }
         }
-        catch (filesystem_error& e) {
-            cerr << "error: No such file or directory: " << e.path1().string() << endl;
+
+        if (!is_stdout || vm.count("outDir")) {
+            try {
+                out_dir = canonical(out_dir);
+            }
+            catch (filesystem_error& e) {
+                cerr << "error: No such file or directory: " << e.path1().string() << endl;
+                return 1;
+            }
+        }
+
+        // a low latency run writes uncompressed reads to stdout and fast
+        // compressed ones to files, unless told otherwise
+        if (use_low_latency && vm["outFormat"].defaulted() && !use_bgzf && is_stdout) {
+            out_format_name = "plain";
+        }
+        block_compressor::block_format out_format;
+        if (out_format_name == "plain" && !use_bgzf) {
+            out_format = block_compressor::PLAIN;
+        }
+        else if (out_format_name == "gzip") {
+            out_format = use_bgzf ? block_compressor::BGZF : block_compressor::GZIP;
+        }
+        else if (out_format_name == "bgzf") {
+            out_format = block_compressor::BGZF;
+        }
+        else if (out_format_name == "zstd" && !use_bgzf) {
+            out_format = block_compressor::ZSTD;
+        }
+        else {
+            cerr << "error: unknown output format or one conflicting with --bgzf: " << out_format_name << endl;
+            return 1;
+        }
+        if (!block_compressor::is_supported(out_format)) {
+            cerr << "error: " << out_format_name << " output is not supported by this build" << endl;
             return 1;
         }
+        string out_extension = (out_format == block_compressor::ZSTD) ? ".fastq.zst" : ((out_format == block_compressor::PLAIN) ? ".fastq" : ".fastq.gz");
 
         // if (vm.count("outBasename")) {
-        if (raw_fq.size() == 1) {
-            clean_fq.push_back(out_dir / path(out_basename + ".clean.fastq.gz"));
-            dropped_fq.push_back(out_dir / path(out_basename + ".dropped.fastq.gz"));
+        if (is_stdout) {
+            // one writer interleaves the ends, the dropped reads are discarded
+            for (int i = 0; i < raw_fq.size(); i++) {
+                clean_fq.push_back(path("-"));
+                dropped_fq.push_back(path("-"));
+            }
+            tmp_dir.clear();
+        }
+        else if (raw_fq.size() == 1) {
+            clean_fq.push_back(out_dir / path(out_basename + ".clean" + out_extension));
+            dropped_fq.push_back(out_dir / path(out_basename + ".dropped" + out_extension));
         }
         else if (raw_fq.size() == 2) {
             for (int i = 0; i < raw_fq.size(); i++) {
-                clean_fq.push_back(out_dir / path(out_basename + "_" + to_string(i + 1) + ".clean.fastq.gz"));
-                dropped_fq.push_back(out_dir / path(out_basename + "_" + to_string(i + 1) + ".dropped.fastq.gz"));
+                clean_fq.push_back(out_dir / path(out_basename + "_" + to_string(i + 1) + ".clean" + out_extension));
+                dropped_fq.push_back(out_dir / path(out_basename + "_" + to_string(i + 1) + ".dropped" + out_extension));
             }
         }
 
-        if (!vm.count("tmpDir")) {
-            // tmp_dir = clean_fq[0].parent_path();
-            tmp_dir = out_dir;
+        // without a tmp directory the outputs are written in place, with one
+        // they are staged there and merged into outDir at the end
+        if (vm.count("tmpDir") && exists(tmp_dir) && equivalent(tmp_dir, out_dir)) {
+            tmp_dir.clear();
         }
 
         if (raw_fq.size() != clean_fq.size()) {
@@ -220,10 +341,48 @@ int main(int argc, char* argv[]) {
                     catch (filesystem_error& e) {
                         cerr << "error: No such file or directory: " << e.path1().string() << endl;
                     }
+                    input_codec::input_format format = input_codec::detect_format(p -> string());
+                    if (!input_codec::is_supported(format)) {
+                        cerr << "error: " << input_codec::format_name(format) << " input is not supported by this build: " << p -> string() << endl;
+                        return 1;
+                    }
                 }
             }
         }
 
+        if (adapter_error_rate < 0 || adapter_error_rate >= 1) {
+            cerr << "error: the adapter error rate should be in [0, 1): " << adapter_error_rate << endl;
+            return 1;
+        }
+        adapter_trimmer::adapter_set adapters(adapter_error_rate, adapter_min_overlap);
+        for (vector<string>::iterator s = adapter_seq.begin(); s != adapter_seq.end(); s++) {
+            bool is_added = is_regular_file(*s) ? adapters.add_fasta(*s) : adapters.add_sequence(*s);
+            if (!is_added) {
+                cerr << "error: neither an adapter sequence nor a FASTA file of them: " << *s << endl;
+                return 1;
+            }
+        }
+
+        if (use_overlap_trim || use_overlap_correction) {
+            if (raw_fq.size() != 2) {
+                cerr << "error: overlap trimming needs paired fastq files" << endl;
+                return 1;
+            }
+            else if (overlap_min_len < 1) {
+                cerr << "error: the minimum overlap should be at least 1: " << overlap_min_len << endl;
+                return 1;
+            }
+            else if (overlap_mismatch_rate < 0 || overlap_mismatch_rate >= 1) {
+                cerr << "error: the overlap mismatch rate should be in [0, 1): " << overlap_mismatch_rate << endl;
+                return 1;
+            }
+        }
+
+        if (window_size < 0 || tail_quality < 0) {
+            cerr << "error: the sliding window size and the tail quality should not be negative" << endl;
+            return 1;
+        }
+
         if (!vm.count("trim")) {
             trim_num = new int[raw_fq.size() * 2]{0};
         }
@@ -265,10 +424,13 @@ int main(int argc, char* argv[]) {
                 vector<path> vv = v.as< vector<path> >();
                 vector<string> ss;
                 for (vector<path>::const_iterator p = vv.begin(); p != vv.end(); p++){
-                    ss.push_back(canonical(*p).string());
+                    ss.push_back((*p == "-") ? p -> string() : canonical(*p).string());
                 }
                 cout << i -> first << "=" << join(ss, ",") << " ";
             }
+            else if (i -> first == "adapterSeq") {
+                cout << i -> first << "=" << join(v.as< vector<string> >(), ",") << " ";
+            }
             else if (v.value().type() == typeid(vector<string>)) {
                 cout << "trim=[";
                 for (int i = 0; i < raw_fq.size() * 2; i++) {
@@ -282,46 +444,182 @@ int main(int argc, char* argv[]) {
         }
         cout << endl;
 
-        cout << log_title() << "INFO -- The cleaned fastq files will be writen to ";
-        for (vector<path>::const_iterator p = clean_fq.begin(); p != clean_fq.end(); p++) {
+        if (is_stdout) {
+            cout << log_title() << "INFO -- The cleaned reads will be writen to stdout"
+                << ((raw_fq.size() == 2) ? " with the pairs interleaved" : "") << ", the dropped reads are discarded." << endl;
+        }
+        for (vector<path>::const_iterator p = clean_fq.begin(); !is_stdout && p != clean_fq.end(); p++) {
+            if (p == clean_fq.begin()) {
+                cout << log_title() << "INFO -- The cleaned fastq files will be writen to ";
+            }
             if ((p + 1) != clean_fq.end()) {
                 cout << (*p).string() << ", ";
             }
             else {
-                cout << (*p).string() << ".";
+                cout << (*p).string() << "." << endl;
             }
         }
-        cout << endl;
-        cout << log_title() << "INFO -- The dropped fastq files will be writen to ";
-        for (vector<path>::const_iterator p = dropped_fq.begin(); p != dropped_fq.end(); p++) {
+        for (vector<path>::const_iterator p = dropped_fq.begin(); !is_stdout && p != dropped_fq.end(); p++) {
+            if (p == dropped_fq.begin()) {
+                cout << log_title() << "INFO -- The dropped fastq files will be writen to ";
+            }
             if ((p + 1) != dropped_fq.end()) {
                 cout << (*p).string() << ", ";
             }
             else {
-                cout << (*p).string() << ".";
+                cout << (*p).string() << "." << endl;
             }
         }
-        cout << endl;
 
-        int* read_info = get_read_info(raw_fq[0]);
-        int read_len = read_info[3];
-        cout << log_title() << "INFO -- After checking " << ((read_info[3] < 4000000) ? read_info[3] : 4000000) << " reads, min quality code is \'" 
-            << (char)read_info[0] 
-            << "\' and max quality code is \'" 
-            << (char)read_info[1] 
-            << "\', the quality system is probably " 
-            << quality_sys[read_info[2]] 
-            << ". " 
-            << "The maximum length of scanned reads is " 
-            << read_info[4] 
-            << "." << endl;
+        if (n_thread < 1) {
+            cout << log_title() << "WARN -- The given number of threads is less than 1, changed it to 1." << endl;
+            n_thread = 1;
+        }
+
+        if (!vm.count("compressThreads")) {
+            n_compress_thread = n_thread;
+        }
+        else if (n_compress_thread < 1) {
+            cout << log_title() << "WARN -- The given number of compression threads is less than 1, changed it to 1." << endl;
+            n_compress_thread = 1;
+        }
+
+        if (use_low_latency && vm["writeBufferSize"].defaulted()) {
+            write_buffer_size = LOW_LATENCY_WRITE_BUFFER_SIZE;
+        }
+        else if (write_buffer_size < 1) {
+            cout << log_title() << "WARN -- The given write buffer size " << write_buffer_size << " KB is less than 1 KB, changed it to 4096 KB." << endl;
+            write_buffer_size = 4096;
+        }
+
+        if (use_low_latency && vm["compressLevel"].defaulted()) {
+            compress_level = 1;
+        }
+        else if (out_format == block_compressor::ZSTD) {
+            if (vm["compressLevel"].defaulted()) {
+                compress_level = 3;
+            }
+            else if (compress_level < 1 || compress_level > 19) {
+                cout << log_title() << "WARN -- The given compression level " << compress_level << " is out of range 1-19, changed it to 3." << endl;
+                compress_level = 3;
+            }
+        }
+        else if (compress_level < 0 || compress_level > 9) {
+            cout << log_title() << "WARN -- The given compression level " << compress_level << " is out of range 0-9, changed it to 6." << endl;
+            compress_level = 6;
+        }
+
+        cout << log_title() << "INFO -- Reads are scanned with the " << read_kernels::kernel_name() << " kernels." << endl;
+        cout << log_title() << "INFO -- gzip input is inflated with " << gzip_codec::inflate_backend();
+        if (out_format == block_compressor::ZSTD) {
+            cout << ", output is compressed with zstd at level " << compress_level << "." << endl;
+        }
+        else if (out_format == block_compressor::PLAIN) {
+            cout << ", output is not compressed." << endl;
+        }
+        else {
+            cout << ", output is deflated with " << gzip_codec::deflate_backend() << "." << endl;
+        }
+        if (use_low_latency) {
+            cout << log_title() << "INFO -- Reads are passed on in batches of " << LOW_LATENCY_BATCH_SIZE
+                << " and the output is flushed after each." << endl;
+        }
+        if (!adapters.empty()) {
+            cout << log_title() << "INFO -- Reads are cut at " << adapters.size() << " adapter sequence(s) allowing "
+                << adapter_error_rate << " mismatches per base and partial matches from " << adapter_min_overlap << " bases." << endl;
+        }
+        if (use_overlap_trim || use_overlap_correction) {
+            cout << log_title() << "INFO -- Pairs are cut to their insert where the mates overlap by at least " << overlap_min_len << " bases with "
+                << overlap_mismatch_rate << " mismatches per base" << (use_overlap_correction ? ", mismatches in the overlap are corrected." : ".") << endl;
+        }
+        if (window_size > 0 || tail_quality > 0) {
+            cout << log_title() << "INFO -- Reads are cut at their 3\' end";
+            if (window_size > 0) {
+                cout << " from the first " << window_size << " bases window of average quality below " << window_quality;
+            }
+            if (tail_quality > 0) {
+                cout << ((window_size > 0) ? " and then" : "") << " by BWA-style trimming at quality " << tail_quality;
+            }
+            cout << ", reads shorter than " << min_read_len << " after that are dropped." << endl;
+        }
+        cout << log_title() << "INFO -- Start filtering..." << endl;
+#ifdef TESTING
+        return 0;
+#endif
+
+        // the statistics start out sized for maxReadLen and grow with longer reads
+        statistic counter(raw_fq.size(), max_read_len);
+        float param_float[5] = {max_base_N_rate, min_ave_quality, max_low_quality_rate, overlap_mismatch_rate, window_quality};
+        vector<read_id_index::fingerprint_set> adapter_read_id_lists;
+        if (adapter.size() != 0) {
+            for (vector<path>::iterator p = adapter.begin(); p != adapter.end(); p++)
+                adapter_read_id_lists.push_back(load_adapter(*p, n_thread, use_adapter_cache));
+        }
+
+        // one reader decompresses the input once and feeds record batches to
+        // the workers, one writer per output compresses what the workers emit
+        fastq_pipeline::batch_scheduler batches(n_thread, 4 * n_thread);
+        vector<fastq_pipeline::record_queue*> clean_queues;
+        vector<fastq_pipeline::record_queue*> dropped_queues;
+        for (int i = 0; i < raw_fq.size(); i++) {
+            clean_queues.push_back(new fastq_pipeline::record_queue(4 * n_thread));
+            dropped_queues.push_back(new fastq_pipeline::record_queue(4 * n_thread));
+        }
+
+        // all writers share one pool that compresses their output blocks in parallel
+        block_compressor::compression_pool compress_pool(n_compress_thread);
+
+        // the quality system is guessed from the first batches the reader
+        // passes on, the workers start once it is settled
+        quality_detector detector(&batches, use_low_latency ? LOW_LATENCY_DETECTION_READS : DETECTION_READS);
+        string read_error;
+        boost::thread reader_thread(reader, raw_fq, &detector, use_low_latency ? LOW_LATENCY_BATCH_SIZE : BATCH_SIZE, n_thread, &read_error);
+        // a writer that fails drains its queues, so the workers run to the
+        // end, and the error is reported once they are done
+        boost::thread_group writer_threads;
+        vector<string> write_errors(raw_fq.size() * 2);
+        auto add_writer = [&](vector<fastq_pipeline::record_queue*> queues, path outfile, string* error) {
+            writer_threads.add_thread(new boost::thread([=, &tmp_dir, &compress_pool]() mutable {
+                try {
+                    writer(queues, outfile, tmp_dir, &compress_pool, compress_level, out_format, (size_t)write_buffer_size * 1024, use_low_latency);
+                }
+                catch (exception& e) {
+                    *error = "Failed to write " + outfile.string() + ": " + e.what();
+                    discarder(queues);
+                }
+            }));
+        };
+        if (is_stdout) {
+            add_writer(clean_queues, clean_fq[0], &write_errors[0]);
+            writer_threads.add_thread(new boost::thread(discarder, dropped_queues));
+        }
+        for (int i = 0; !is_stdout && i < raw_fq.size(); i++) {
+            add_writer(vector<fastq_pipeline::record_queue*>(1, clean_queues[i]), clean_fq[i], &write_errors[2 * i]);
+            add_writer(vector<fastq_pipeline::record_queue*>(1, dropped_queues[i]), dropped_fq[i], &write_errors[2 * i + 1]);
+        }
+
+        // a reader that fails sets read_error before it closes the detector,
+        // there is nothing to guess from then
+        int guessed_quality_sys = detector.quality_system();
+        if (read_error.empty()) {
+            cout << log_title() << "INFO -- After checking " << detector.read_count() << " reads, min quality code is \'" 
+                << detector.min_quality() 
+                << "\' and max quality code is \'" 
+                << detector.max_quality() 
+                << "\', the quality system is probably " 
+                << quality_sys[guessed_quality_sys] 
+                << ". " 
+                << "The maximum length of scanned reads is " 
+                << detector.max_read_len() 
+                << "." << endl;
+        }
         if (prefer_specified_raw_quality_sys) {
             cout << log_title() << "WARN -- User prefered specified quality system "
                 << quality_sys[raw_quality_sys]
                 << ". The program will treat quality codes correspondingly." << endl;
         }
         else {
-            raw_quality_sys = read_info[2];
+            raw_quality_sys = guessed_quality_sys;
             cout << log_title() << "INFO -- The program will treat quality codes in accordance to "
                 << quality_sys[raw_quality_sys] << "." << endl;
         }
@@ -335,70 +633,87 @@ int main(int argc, char* argv[]) {
                 << quality_sys[clean_quality_sys] << "." << endl;
         }
 
-        if (read_info[4] > max_read_len) {
-            max_read_len = read_info[4];
-            cout << log_title() << "WARN -- The maximum read length exceeds the given maximum read length (100), change it to " << max_read_len << "." << endl;
-        }
-
-        if (n_thread > 8) {
-            cout << log_title() << "WARN -- The given number of threads exceeds the maximum (8), changed it to 8." << endl;
-            n_thread = 8;
-        }
-
-        if (read_info[3] < THREAD_BLOCK_SIZE * n_thread) {
-            cout << log_title() << "WARN -- " << n_thread << " threads are redundant for filtering the given fastq(s), it is automatically adjusted to ";
-            n_thread = (read_info[3] / THREAD_BLOCK_SIZE == 0) ? read_info[3] / THREAD_BLOCK_SIZE + 1 : read_info[3] / THREAD_BLOCK_SIZE;
-            cout << n_thread << " threads in accordance with the given fastq(s)." << endl;
-        }
-        delete read_info;
-
-        cout << log_title() << "INFO -- Start filtering..." << endl;
-#ifdef TESTING
-        return 0;
-#endif
-
-        statistic counter(raw_fq.size(), max_read_len);
         int * param_int;
+        // after the trimmed bases of each end come the minimum overlap of the
+        // mates (0 without overlap trimming), whether to correct it, and the
+        // quality trimming window size and tail quality
         if (raw_fq.size() == 1) {
-            param_int = new int[5 + 2]{min_base_quality, raw_quality_sys, clean_quality_sys, max_read_len, min_read_len, trim_num[0], trim_num[1]};
+            param_int = new int[5 + 2 + 4]{min_base_quality, raw_quality_sys, clean_quality_sys, max_read_len, min_read_len, trim_num[0], trim_num[1],
+                0, 0, window_size, tail_quality};
         }
         else if (raw_fq.size() == 2) {
-            param_int = new int[5 + 4]{min_base_quality, raw_quality_sys, clean_quality_sys, max_read_len, min_read_len, trim_num[0], trim_num[1], trim_num[2], trim_num[3]};
-        }
-        float param_float[3] = {max_base_N_rate, min_ave_quality, max_low_quality_rate};
-        boost::thread t[n_thread];
-        int thread_info[n_thread][3];
-
-        vector< unordered_set<string> > adapter_read_id_lists;
-        if (adapter.size() != 0) {
-            for (vector<path>::iterator p = adapter.begin(); p != adapter.end(); p++)
-                adapter_read_id_lists.push_back(load_adapter(*p));
+            param_int = new int[5 + 4 + 4]{min_base_quality, raw_quality_sys, clean_quality_sys, max_read_len, min_read_len, trim_num[0], trim_num[1], trim_num[2], trim_num[3],
+                (use_overlap_trim || use_overlap_correction) ? overlap_min_len : 0, use_overlap_correction, window_size, tail_quality};
         }
 
+        boost::thread t[n_thread];
         for (int i = 0; i < n_thread; i++) {
-            thread_info[i][0] = THREAD_BLOCK_SIZE;
-            thread_info[i][1] = n_thread;
-            thread_info[i][2] = i;
             t[i] = boost::thread(processor, 
-                    raw_fq, 
-                    clean_fq, 
-                    dropped_fq, 
-                    tmp_dir,
+                    &batches, 
+                    clean_queues, 
+                    dropped_queues, 
                     adapter_read_id_lists, 
+                    &adapters, 
                     param_int, 
                     param_float, 
-                    &counter, 
-                    thread_info[i]);
+                    &counter,
+                    i);
         }
 
         for (int i = 0; i < n_thread; i++)
             t[i].join();
+        reader_thread.join();
+
+        for (int i = 0; i < raw_fq.size(); i++) {
+            clean_queues[i] -> close();
+            dropped_queues[i] -> close();
+        }
+        writer_threads.join_all();
+        if (!read_error.empty()) {
+            cout << log_title() << "ERROR -- " << read_error << endl;
+        }
+        int n_write_failed = 0;
+        for (vector<string>::const_iterator e = write_errors.begin(); e != write_errors.end(); e++) {
+            if (!e -> empty()) {
+                cout << log_title() << "ERROR -- " << *e << endl;
+                n_write_failed++;
+            }
+        }
+        for (int i = 0; i < raw_fq.size(); i++) {
+            delete clean_queues[i];
+            delete dropped_queues[i];
+        }
+        for (int i = 0; i < n_thread; i++) {
+            cout << log_title() << "INFO -- Thread " << i << " processed "
+                << batches.batch_count(i) << " batches ("
+                << batches.stolen_count(i) << " stolen from other threads)." << endl;
+        }
 
-        write_statistic(counter, out_dir);
+        // what was staged is left in tmpDir rather than merged incomplete, and
+        // the statistics of an input that could not be read are not written
+        if (!read_error.empty()) {
+            time_duration dt = second_clock::local_time() - start_time;
+            cout << log_title() << "ERROR -- The input could not be read. "
+                << dt.total_seconds() << " seconds elapsed." << endl;
+            return 1;
+        }
+
+        if (!out_dir.empty()) {
+            write_statistic(counter, out_dir);
+        }
 
-        cout << log_title() << "INFO -- Merging tmp files..." << endl;
-        merge(clean_fq, dropped_fq, tmp_dir, n_thread);
-        cout << log_title() << "INFO -- Merge completed!" << endl;
+        if (n_write_failed > 0) {
+            time_duration dt = second_clock::local_time() - start_time;
+            cout << log_title() << "ERROR -- " << n_write_failed << " output fastq file(s) could not be written. "
+                << dt.total_seconds() << " seconds elapsed." << endl;
+            return 1;
+        }
+
+        if (!tmp_dir.empty()) {
+            cout << log_title() << "INFO -- Merging tmp files..." << endl;
+            merge(clean_fq, dropped_fq, tmp_dir);
+            cout << log_title() << "INFO -- Merge completed!" << endl;
+        }
 
         ptime end_time = second_clock::local_time();
         time_duration dt = end_time - start_time;
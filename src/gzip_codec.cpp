@@ -0,0 +1,318 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#if defined(HAVE_LIBDEFLATE)
+#include <libdeflate.h>
+#endif
+#if defined(HAVE_ISAL)
+#include <isa-l/igzip_lib.h>
+#endif
+// zlib-ng in its native API has the zlib calls prefixed with zng_, built in
+// compat mode it simply replaces libz and needs nothing here
+#if defined(HAVE_ZLIB_NG)
+#include <zlib-ng.h>
+#define ZLIB_CALL(name) ::zng_##name
+typedef zng_stream zlib_stream;
+#else
+#include <zlib.h>
+#define ZLIB_CALL(name) ::name
+typedef z_stream zlib_stream;
+#endif
+#include <gzip_codec.hpp>
+
+namespace gzip_codec {
+    const size_t INPUT_BUFFER_SIZE = 1 << 18;
+
+    const char* inflate_backend() {
+#if defined(HAVE_ISAL)
+        return "ISA-L";
+#elif defined(HAVE_ZLIB_NG)
+        return "zlib-ng";
+#else
+        return "zlib";
+#endif
+    }
+
+    const char* deflate_backend() {
+#if defined(HAVE_LIBDEFLATE)
+        return "libdeflate";
+#elif defined(HAVE_ZLIB_NG)
+        return "zlib-ng";
+#else
+        return "zlib";
+#endif
+    }
+
+    static void init_zlib_stream(zlib_stream& stream) {
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        stream.next_in = Z_NULL;
+        stream.avail_in = 0;
+    }
+
+#if defined(HAVE_LIBDEFLATE)
+    // libdeflate compressors are large, every pool thread keeps one for the
+    // level it was last asked for
+    struct compressor_cache {
+        libdeflate_compressor* compressor;
+        int level;
+
+        compressor_cache() : compressor(NULL), level(-1) {}
+        ~compressor_cache() {
+            if (compressor != NULL) {
+                libdeflate_free_compressor(compressor);
+            }
+        }
+
+        libdeflate_compressor* get(int new_level) {
+            if (new_level != level) {
+                if (compressor != NULL) {
+                    libdeflate_free_compressor(compressor);
+                }
+                compressor = libdeflate_alloc_compressor(new_level);
+                if (compressor == NULL) {
+                    throw std::runtime_error("failed to initialize libdeflate compressor");
+                }
+                level = new_level;
+            }
+            return compressor;
+        }
+    };
+
+    static thread_local compressor_cache compressors;
+#endif
+
+    unsigned long crc32(const char* data, size_t size) {
+#if defined(HAVE_LIBDEFLATE)
+        return libdeflate_crc32(0, data, size);
+#else
+        return ZLIB_CALL(crc32)(0, (const unsigned char*)data, size);
+#endif
+    }
+
+    void deflate_gzip(const char* data, size_t size, int level, std::string& output) {
+#if defined(HAVE_LIBDEFLATE)
+        // level 0 is left to zlib, older libdeflate releases do not store
+        if (level > 0) {
+            libdeflate_compressor* compressor = compressors.get(level);
+            output.resize(libdeflate_gzip_compress_bound(compressor, size));
+            size_t n = libdeflate_gzip_compress(compressor, data, size, &output[0], output.size());
+            if (n == 0) {
+                throw std::runtime_error("failed to compress gzip block");
+            }
+            output.resize(n);
+            return;
+        }
+#endif
+        zlib_stream stream;
+        init_zlib_stream(stream);
+        // window bits 15 + 16 asks zlib for a gzip header and trailer
+        if (ZLIB_CALL(deflateInit2)(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("failed to initialize gzip compressor");
+        }
+        output.resize(ZLIB_CALL(deflateBound)(&stream, size));
+        stream.next_in = (unsigned char*)data;
+        stream.avail_in = size;
+        stream.next_out = (unsigned char*)&output[0];
+        stream.avail_out = output.size();
+        if (ZLIB_CALL(deflate)(&stream, Z_FINISH) != Z_STREAM_END) {
+            ZLIB_CALL(deflateEnd)(&stream);
+            throw std::runtime_error("failed to compress gzip block");
+        }
+        output.resize(stream.total_out);
+        ZLIB_CALL(deflateEnd)(&stream);
+    }
+
+    bool deflate_raw(const char* data, size_t size, int level, char* out, size_t& out_size) {
+#if defined(HAVE_LIBDEFLATE)
+        if (level > 0) {
+            out_size = libdeflate_deflate_compress(compressors.get(level), data, size, out, out_size);
+            return out_size > 0;
+        }
+#endif
+        zlib_stream stream;
+        init_zlib_stream(stream);
+        if (ZLIB_CALL(deflateInit2)(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("failed to initialize raw deflate compressor");
+        }
+        stream.next_in = (unsigned char*)data;
+        stream.avail_in = size;
+        stream.next_out = (unsigned char*)out;
+        stream.avail_out = out_size;
+        int status = ZLIB_CALL(deflate)(&stream, Z_FINISH);
+        out_size = stream.total_out;
+        ZLIB_CALL(deflateEnd)(&stream);
+        return status == Z_STREAM_END;
+    }
+
+    struct block_inflater::state {
+#if defined(HAVE_LIBDEFLATE)
+        libdeflate_decompressor* decompressor;
+#elif defined(HAVE_ISAL)
+        inflate_state stream;
+#else
+        zlib_stream stream;
+#endif
+    };
+
+    block_inflater::block_inflater() : impl(new state()) {
+#if defined(HAVE_LIBDEFLATE)
+        impl -> decompressor = libdeflate_alloc_decompressor();
+        if (impl -> decompressor == NULL) {
+            delete impl;
+            throw std::runtime_error("failed to initialize libdeflate decompressor");
+        }
+#elif !defined(HAVE_ISAL)
+        init_zlib_stream(impl -> stream);
+        if (ZLIB_CALL(inflateInit2)(&impl -> stream, -15) != Z_OK) {
+            delete impl;
+            throw std::runtime_error("failed to initialize raw inflate decompressor");
+        }
+#endif
+    }
+
+    block_inflater::~block_inflater() {
+#if defined(HAVE_LIBDEFLATE)
+        libdeflate_free_decompressor(impl -> decompressor);
+#elif !defined(HAVE_ISAL)
+        ZLIB_CALL(inflateEnd)(&impl -> stream);
+#endif
+        delete impl;
+    }
+
+    bool block_inflater::inflate(const char* data, size_t size, char* out, size_t out_size) {
+#if defined(HAVE_LIBDEFLATE)
+        // without an actual size libdeflate insists on filling out exactly
+        return libdeflate_deflate_decompress(impl -> decompressor, data, size, out, out_size, NULL) == LIBDEFLATE_SUCCESS;
+#elif defined(HAVE_ISAL)
+        inflate_state& stream = impl -> stream;
+        isal_inflate_init(&stream);
+        stream.crc_flag = ISAL_DEFLATE;
+        stream.next_in = (uint8_t*)data;
+        stream.avail_in = size;
+        stream.next_out = (uint8_t*)out;
+        stream.avail_out = out_size;
+        return isal_inflate_stateless(&stream) == ISAL_DECOMP_OK && stream.total_out == out_size;
+#else
+        zlib_stream& stream = impl -> stream;
+        ZLIB_CALL(inflateReset)(&stream);
+        stream.next_in = (unsigned char*)data;
+        stream.avail_in = size;
+        stream.next_out = (unsigned char*)out;
+        stream.avail_out = out_size;
+        return ZLIB_CALL(inflate)(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == out_size;
+#endif
+    }
+
+    // The stream sits between two members until input is left after the end
+    // of a member, a new member is then started on it. A file cut off within
+    // a member ends with the data that could still be inflated.
+    struct gzip_source::state {
+        std::unique_ptr<std::istream> file;
+        std::istream& in;
+        std::vector<char> input;
+        bool is_input_eof;
+        bool is_member_end;
+#if defined(HAVE_ISAL)
+        inflate_state stream;
+#else
+        zlib_stream stream;
+#endif
+
+        state(std::istream* file, std::istream& in)
+                : file(file), in(in), input(INPUT_BUFFER_SIZE), is_input_eof(false), is_member_end(true) {
+#if defined(HAVE_ISAL)
+            isal_inflate_init(&stream);
+            stream.next_in = NULL;
+            stream.avail_in = 0;
+#else
+            init_zlib_stream(stream);
+            // window bits 15 + 16 only accepts gzip headers
+            if (ZLIB_CALL(inflateInit2)(&stream, 15 + 16) != Z_OK) {
+                throw std::runtime_error("failed to initialize gzip decompressor");
+            }
+#endif
+        }
+
+        ~state() {
+#if !defined(HAVE_ISAL)
+            ZLIB_CALL(inflateEnd)(&stream);
+#endif
+        }
+
+        void refill() {
+            in.read(input.data(), input.size());
+            size_t n_read = in.gcount();
+            is_input_eof = n_read == 0;
+            stream.next_in = (unsigned char*)input.data();
+            stream.avail_in = n_read;
+        }
+
+        void start_member() {
+#if defined(HAVE_ISAL)
+            // keeps the input that is left after the previous member
+            unsigned char* next_in = stream.next_in;
+            size_t avail_in = stream.avail_in;
+            isal_inflate_reset(&stream);
+            stream.crc_flag = ISAL_GZIP;
+            stream.next_in = next_in;
+            stream.avail_in = avail_in;
+#else
+            ZLIB_CALL(inflateReset)(&stream);
+#endif
+            is_member_end = false;
+        }
+
+        size_t inflate(char* out, size_t size) {
+            stream.next_out = (unsigned char*)out;
+            stream.avail_out = size;
+#if defined(HAVE_ISAL)
+            if (isal_inflate(&stream) != ISAL_DECOMP_OK) {
+                throw std::runtime_error("failed to decompress gzip stream");
+            }
+            is_member_end = stream.block_state == ISAL_BLOCK_FINISH;
+#else
+            int status = ZLIB_CALL(inflate)(&stream, Z_NO_FLUSH);
+            if (status == Z_STREAM_END) {
+                is_member_end = true;
+            }
+            else if (status != Z_OK && status != Z_BUF_ERROR) {
+                throw std::runtime_error("failed to decompress gzip stream");
+            }
+#endif
+            return size - stream.avail_out;
+        }
+    };
+
+    gzip_source::gzip_source(const std::string& filename) {
+        std::istream* file = new std::ifstream(filename, std::ios_base::in | std::ios_base::binary);
+        impl.reset(new state(file, *file));
+    }
+
+    gzip_source::gzip_source(std::istream& in) : impl(new state(NULL, in)) {}
+
+    std::streamsize gzip_source::read(char* s, std::streamsize n) {
+        std::streamsize n_out = 0;
+        while (n_out < n) {
+            if (impl -> stream.avail_in == 0 && !impl -> is_input_eof) {
+                impl -> refill();
+            }
+            if (impl -> is_member_end) {
+                if (impl -> stream.avail_in == 0) {
+                    break;
+                }
+                impl -> start_member();
+            }
+            size_t n_inflated = impl -> inflate(s + n_out, n - n_out);
+            if (n_inflated == 0 && impl -> stream.avail_in == 0 && impl -> is_input_eof) {
+                break;
+            }
+            n_out += n_inflated;
+        }
+        return (n_out == 0) ? -1 : n_out;
+    }
+}
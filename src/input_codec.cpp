@@ -0,0 +1,376 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+#if defined(HAVE_BZIP2)
+#include <bzlib.h>
+#endif
+#include <block_decompressor.hpp>
+#include <gzip_codec.hpp>
+#include <input_codec.hpp>
+
+namespace input_codec {
+    const size_t INPUT_BUFFER_SIZE = 1 << 18;
+
+    const size_t MAGIC_SIZE = 4;
+
+    static input_format detect_format(const unsigned char* magic, size_t n_read) {
+        if (n_read >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+            return GZIP;
+        }
+        if (n_read >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+            return ZSTD;
+        }
+        if (n_read >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h') {
+            return BZIP2;
+        }
+        return PLAIN;
+    }
+
+    input_format detect_format(const std::string& filename) {
+        if (filename == "-") {
+            // looking would take the bytes away from the reader
+            return PLAIN;
+        }
+        std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+        unsigned char magic[MAGIC_SIZE] = {0};
+        in.read((char*)magic, sizeof(magic));
+        input_format format = detect_format(magic, in.gcount());
+        if (format == GZIP && block_decompressor::is_bgzf(filename)) {
+            return BGZF;
+        }
+        return format;
+    }
+
+    const char* format_name(input_format format) {
+        switch (format) {
+            case GZIP:
+                return "gzip";
+            case BGZF:
+                return "BGZF";
+            case ZSTD:
+                return "zstd";
+            case BZIP2:
+                return "bzip2";
+            default:
+                return "plain text";
+        }
+    }
+
+    bool is_supported(input_format format) {
+        switch (format) {
+            case ZSTD:
+#if defined(HAVE_ZSTD)
+                return true;
+#else
+                return false;
+#endif
+            case BZIP2:
+#if defined(HAVE_BZIP2)
+                return true;
+#else
+                return false;
+#endif
+            default:
+                return true;
+        }
+    }
+
+    // what input_source reads through, one kind per format
+    class decoder {
+        public:
+            virtual ~decoder() {}
+            // -1 once the input is exhausted
+            virtual std::streamsize read(char*, std::streamsize) = 0;
+    };
+
+    class plain_decoder : public decoder {
+        public:
+            plain_decoder(std::istream& in) : in(in) {}
+
+            std::streamsize read(char* s, std::streamsize n) {
+                in.read(s, n);
+                std::streamsize n_read = in.gcount();
+                return (n_read == 0) ? -1 : n_read;
+            }
+
+        private:
+            std::istream& in;
+    };
+
+    class gzip_decoder : public decoder {
+        public:
+            gzip_decoder(std::istream& in) : source(in) {}
+            std::streamsize read(char* s, std::streamsize n) {return source.read(s, n);}
+
+        private:
+            gzip_codec::gzip_source source;
+    };
+
+#if defined(HAVE_ZSTD)
+    // A zstd stream carries on into the next frame by itself. As with gzip,
+    // a file cut off within a frame ends with the data that could still be
+    // decompressed.
+    class zstd_decoder : public decoder {
+        public:
+            zstd_decoder(std::istream& in) : in(in), input(ZSTD_DStreamInSize()), is_input_eof(false) {
+                stream = ZSTD_createDStream();
+                if (stream == NULL) {
+                    throw std::runtime_error("failed to initialize zstd decompressor");
+                }
+                ZSTD_initDStream(stream);
+                in_buffer.src = input.data();
+                in_buffer.size = 0;
+                in_buffer.pos = 0;
+            }
+
+            ~zstd_decoder() {
+                ZSTD_freeDStream(stream);
+            }
+
+            std::streamsize read(char* s, std::streamsize n) {
+                ZSTD_outBuffer out_buffer = {s, (size_t)n, 0};
+                while (out_buffer.pos < out_buffer.size) {
+                    if (in_buffer.pos == in_buffer.size && !is_input_eof) {
+                        in.read(input.data(), input.size());
+                        in_buffer.size = in.gcount();
+                        in_buffer.pos = 0;
+                        is_input_eof = in_buffer.size == 0;
+                    }
+                    size_t n_out = out_buffer.pos;
+                    size_t n_in = in_buffer.pos;
+                    if (ZSTD_isError(ZSTD_decompressStream(stream, &out_buffer, &in_buffer))) {
+                        throw std::runtime_error("failed to decompress zstd stream");
+                    }
+                    // with the input gone, only data still held by the stream comes out
+                    if (is_input_eof && out_buffer.pos == n_out && in_buffer.pos == n_in) {
+                        break;
+                    }
+                }
+                return (out_buffer.pos == 0) ? -1 : out_buffer.pos;
+            }
+
+        private:
+            std::istream& in;
+            std::vector<char> input;
+            ZSTD_DStream* stream;
+            ZSTD_inBuffer in_buffer;
+            bool is_input_eof;
+    };
+#endif
+
+#if defined(HAVE_BZIP2)
+    // Parallel bzip2 tools write one stream per block, a new stream is
+    // started on the input left after the end of one.
+    class bzip2_decoder : public decoder {
+        public:
+            bzip2_decoder(std::istream& in) : in(in), input(INPUT_BUFFER_SIZE), is_input_eof(false), is_stream_end(false) {
+                memset(&stream, 0, sizeof(stream));
+                if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+                    throw std::runtime_error("failed to initialize bzip2 decompressor");
+                }
+            }
+
+            ~bzip2_decoder() {
+                BZ2_bzDecompressEnd(&stream);
+            }
+
+            std::streamsize read(char* s, std::streamsize n) {
+                stream.next_out = s;
+                stream.avail_out = n;
+                while (stream.avail_out > 0) {
+                    if (stream.avail_in == 0 && !is_input_eof) {
+                        in.read(input.data(), input.size());
+                        stream.next_in = input.data();
+                        stream.avail_in = in.gcount();
+                        is_input_eof = stream.avail_in == 0;
+                    }
+                    if (is_stream_end) {
+                        if (stream.avail_in == 0) {
+                            break;
+                        }
+                        // keeps the input that is left after the previous stream
+                        char* next_in = stream.next_in;
+                        unsigned int avail_in = stream.avail_in;
+                        BZ2_bzDecompressEnd(&stream);
+                        if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+                            throw std::runtime_error("failed to initialize bzip2 decompressor");
+                        }
+                        stream.next_in = next_in;
+                        stream.avail_in = avail_in;
+                        stream.next_out = s + (n - stream.avail_out);
+                        is_stream_end = false;
+                    }
+                    unsigned int avail_out = stream.avail_out;
+                    int status = BZ2_bzDecompress(&stream);
+                    if (status == BZ_STREAM_END) {
+                        is_stream_end = true;
+                    }
+                    else if (status != BZ_OK) {
+                        throw std::runtime_error("failed to decompress bzip2 stream");
+                    }
+                    else if (stream.avail_out == avail_out && stream.avail_in == 0 && is_input_eof) {
+                        break;
+                    }
+                }
+                std::streamsize n_out = n - stream.avail_out;
+                return (n_out == 0) ? -1 : n_out;
+            }
+
+        private:
+            std::istream& in;
+            std::vector<char> input;
+            bz_stream stream;
+            bool is_input_eof;
+            bool is_stream_end;
+    };
+#endif
+
+    typedef boost::iostreams::stream<boost::iostreams::file_descriptor_source> stdin_istream;
+
+    // The decoder reads the raw bytes from the file or from stdin. The first
+    // bytes are read to tell the format and then handed back to the stream,
+    // by seeking for a file and from its buffer for stdin.
+    struct input_source::state {
+        std::unique_ptr<std::istream> raw;
+        input_format format;
+        std::unique_ptr<decoder> source;
+    };
+
+    input_source::input_source(const std::string& filename) : impl(new state()) {
+        if (filename == "-") {
+            impl -> raw.reset(new stdin_istream(boost::iostreams::file_descriptor_source(STDIN_FILENO, boost::iostreams::never_close_handle), INPUT_BUFFER_SIZE));
+        }
+        else {
+            impl -> raw.reset(new std::ifstream(filename, std::ios_base::in | std::ios_base::binary));
+        }
+        std::istream& raw = *impl -> raw;
+        unsigned char magic[MAGIC_SIZE] = {0};
+        raw.read((char*)magic, sizeof(magic));
+        size_t n_read = raw.gcount();
+        raw.clear();
+        if (filename == "-") {
+            for (size_t i = 0; i < n_read; i++) {
+                raw.unget();
+            }
+        }
+        else {
+            raw.seekg(0);
+        }
+        if (!raw) {
+            throw std::runtime_error("failed to read the start of " + filename);
+        }
+        impl -> format = (filename == "-") ? detect_format(magic, n_read) : detect_format(filename);
+
+        switch (impl -> format) {
+            case GZIP:
+            case BGZF:
+                impl -> source.reset(new gzip_decoder(raw));
+                break;
+#if defined(HAVE_ZSTD)
+            case ZSTD:
+                impl -> source.reset(new zstd_decoder(raw));
+                break;
+#endif
+#if defined(HAVE_BZIP2)
+            case BZIP2:
+                impl -> source.reset(new bzip2_decoder(raw));
+                break;
+#endif
+            case PLAIN:
+                impl -> source.reset(new plain_decoder(raw));
+                break;
+            default:
+                throw std::runtime_error(std::string(format_name(impl -> format)) + " input is not supported by this build");
+        }
+    }
+
+    std::streamsize input_source::read(char* s, std::streamsize n) {
+        return impl -> source -> read(s, n);
+    }
+
+    input_format input_source::format() const {
+        return impl -> format;
+    }
+
+    mapped_file::mapped_file(const std::string& filename) : base(NULL), length(0) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw std::runtime_error("failed to open " + filename);
+        }
+        length = file_stat.st_size;
+        if (length > 0) {
+            void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("failed to map " + filename);
+            }
+            madvise(p, length, MADV_SEQUENTIAL);
+            base = (const char*)p;
+        }
+        close(fd);
+    }
+
+    mapped_file::~mapped_file() {
+        if (base != NULL) {
+            munmap((void*)base, length);
+        }
+    }
+
+    // an @ line, the read, a + line and a quality as long as the read
+    static bool is_record_start(const char* p, const char* end) {
+        const char* line_begin[4];
+        const char* line_end[4];
+        for (int i = 0; i < 4; i++) {
+            line_begin[i] = p;
+            const char* newline = (p < end) ? (const char*)memchr(p, '\n', end - p) : NULL;
+            if (newline == NULL && i < 3) {
+                return false;
+            }
+            line_end[i] = (newline == NULL) ? end : newline;
+            p = line_end[i] + 1;
+        }
+        return line_begin[0] < line_end[0] && *line_begin[0] == '@'
+            && line_begin[2] < line_end[2] && *line_begin[2] == '+'
+            && line_end[1] - line_begin[1] == line_end[3] - line_begin[3];
+    }
+
+    std::vector<unsigned long> split_records(const mapped_file& file, int n) {
+        const char* data = file.data();
+        const char* end = data + file.size();
+        std::vector<unsigned long> offsets(1, 0);
+        for (int i = 1; i < n; i++) {
+            unsigned long target = file.size() / n * i;
+            if (target <= offsets.back()) {
+                continue;
+            }
+            // the first record beginning at or after the target
+            const char* newline = (const char*)memchr(data + target - 1, '\n', end - (data + target - 1));
+            while (newline != NULL && !is_record_start(newline + 1, end)) {
+                newline = (const char*)memchr(newline + 1, '\n', end - (newline + 1));
+            }
+            if (newline == NULL || newline + 1 >= end) {
+                break;
+            }
+            offsets.push_back(newline + 1 - data);
+        }
+        offsets.push_back(file.size());
+        return offsets;
+    }
+}
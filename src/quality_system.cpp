@@ -1,20 +1,67 @@
+#include <cmath>
 #include <string>
+#include <vector>
+#include <read_kernels.hpp>
 
 namespace quality_system {
     char zero_quality[5] = {'!', '@', '@', '@', '!'};
+    // lowest code written in every system, Solexa scores go down to -5
+    // and Illumina 1.5+ starts at 'B'
+    char min_quality[5] = {'!', ';', '@', 'B', '!'};
+    const int SOLEXA = 1;
+    const char MAX_QUALITY = '~';
 
-    void quality_system_convert(std::string& quality_seq, const int from_sys, const int to_sys) {
-        int diff = zero_quality[to_sys] - zero_quality[from_sys];
-        for (std::string::iterator c = quality_seq.begin(); c != quality_seq.end(); c++) {
-            *c += diff;
-            if (*c < zero_quality[to_sys]) {
-                *c = zero_quality[to_sys];
-            }
-            if (to_sys == 3) {
-                if (*c < 'B') {
-                    *c = 'B';
+    static int phred_from_solexa(int score) {
+        return (int)std::floor(10 * std::log10(std::pow(10.0, score / 10.0) + 1) + 0.5);
+    }
+
+    static int solexa_from_phred(int score) {
+        if (score <= 0) {
+            return -5;
+        }
+        return (int)std::floor(10 * std::log10(std::pow(10.0, score / 10.0) - 1) + 0.5);
+    }
+
+    // Byte tables for every pair of systems. Solexa scores are log-odds and
+    // map to Phred scores (and back) non-linearly, the other systems only
+    // differ by offset.
+    static std::vector<std::string> make_conversion_tables() {
+        std::vector<std::string> tables(25, std::string(256, 0));
+        for (int from_sys = 0; from_sys < 5; from_sys++) {
+            for (int to_sys = 0; to_sys < 5; to_sys++) {
+                std::string& table = tables[5 * from_sys + to_sys];
+                for (int c = 0; c < 256; c++) {
+                    int score = (signed char)c - zero_quality[from_sys];
+                    if (from_sys == SOLEXA && to_sys != SOLEXA) {
+                        score = phred_from_solexa(score);
+                    }
+                    else if (to_sys == SOLEXA && from_sys != SOLEXA) {
+                        score = solexa_from_phred(score);
+                    }
+                    int code = score + zero_quality[to_sys];
+                    table[c] = (code < min_quality[to_sys]) ? min_quality[to_sys] : ((code > MAX_QUALITY) ? MAX_QUALITY : code);
                 }
             }
         }
+        return tables;
+    }
+
+    static const std::vector<std::string> conversion_tables = make_conversion_tables();
+
+    void quality_system_convert(char* quality_seq, size_t size, const int from_sys, const int to_sys) {
+        if (from_sys != SOLEXA && to_sys != SOLEXA) {
+            read_kernels::add_clamp(quality_seq, size, zero_quality[to_sys] - zero_quality[from_sys], min_quality[to_sys], MAX_QUALITY);
+            return;
+        }
+        const std::string& table = conversion_tables[5 * from_sys + to_sys];
+        for (size_t i = 0; i < size; i++) {
+            quality_seq[i] = table[(unsigned char)quality_seq[i]];
+        }
+    }
+
+    void quality_system_convert(std::string& quality_seq, const int from_sys, const int to_sys) {
+        if (!quality_seq.empty()) {
+            quality_system_convert(&quality_seq[0], quality_seq.size(), from_sys, to_sys);
+        }
     }
 }
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+#include <read_id_index.hpp>
+
+namespace read_id_index {
+    const char FILE_MAGIC[8] = {'F', 'Q', 'F', 'P', 'I', 'D', 'X', '1'};
+    const uint64_t BYTE_ORDER_MARK = 0x0102030405060708ull;
+
+    // 64 bytes ahead of tree[0, n_key] in a saved set
+    struct file_header {
+        char magic[8];
+        uint64_t byte_order;
+        uint64_t n_key;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t reserved[3];
+    };
+
+    static inline uint64_t mix(uint64_t a, uint64_t b) {
+        unsigned __int128 product = (unsigned __int128)a * b;
+        return (uint64_t)product ^ (uint64_t)(product >> 64);
+    }
+
+    uint64_t fingerprint(const char* id, size_t size) {
+        const uint64_t P0 = 0xa0761d6478bd642full;
+        const uint64_t P1 = 0xe7037ed1a0b428dbull;
+        const uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+        uint64_t h = mix(size ^ P0, P1);
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, id, 8);
+            h = mix(h ^ word, P1);
+            id += 8;
+            size -= 8;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, id, size);
+        return mix(h ^ tail, P2);
+    }
+
+    // the sorted keys are placed by an in-order walk of the implicit tree
+    // with children 2k and 2k + 1
+    static size_t place(const std::vector<uint64_t>& sorted, size_t i, uint64_t* tree, size_t k) {
+        if (k <= sorted.size()) {
+            i = place(sorted, i, tree, 2 * k);
+            tree[k] = sorted[i++];
+            i = place(sorted, i, tree, 2 * k + 1);
+        }
+        return i;
+    }
+
+    static void sort_range(std::vector<uint64_t>* keys, size_t begin, size_t end) {
+        std::sort(keys -> begin() + begin, keys -> begin() + end);
+    }
+
+    static void merge_ranges(std::vector<uint64_t>* keys, size_t begin, size_t middle, size_t end) {
+        std::inplace_merge(keys -> begin() + begin, keys -> begin() + middle, keys -> begin() + end);
+    }
+
+    void fingerprint_set::build(int n_thread) {
+        // the runs are sorted in parallel and then merged pairwise, every
+        // round of merges running in parallel as well
+        std::vector<size_t> bounds;
+        for (int i = 0; i <= n_thread; i++) {
+            bounds.push_back(keys.size() / n_thread * i);
+        }
+        bounds.back() = keys.size();
+        boost::thread_group sorters;
+        for (int i = 0; i < n_thread; i++) {
+            sorters.create_thread(boost::bind(sort_range, &keys, bounds[i], bounds[i + 1]));
+        }
+        sorters.join_all();
+        while (bounds.size() > 2) {
+            std::vector<size_t> merged(1, 0);
+            boost::thread_group mergers;
+            for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+                mergers.create_thread(boost::bind(merge_ranges, &keys, bounds[i], bounds[i + 1], bounds[i + 2]));
+                merged.push_back(bounds[i + 2]);
+            }
+            mergers.join_all();
+            if (merged.back() != bounds.back()) {
+                merged.push_back(bounds.back());
+            }
+            bounds.swap(merged);
+        }
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        n_key = keys.size();
+        uint64_t* nodes = new uint64_t[n_key + 1];
+        nodes[0] = 0;
+        place(keys, 0, nodes, 1);
+        tree.reset(nodes, std::default_delete<uint64_t[]>());
+        std::vector<uint64_t>().swap(keys);
+    }
+
+    bool fingerprint_set::contains(uint64_t key) const {
+        if (n_key == 0) {
+            return false;
+        }
+        const uint64_t* tree = this -> tree.get();
+        size_t k = 1;
+        while (k <= n_key) {
+            // the node four levels down is fetched while the comparisons go on
+            __builtin_prefetch(tree + 16 * k);
+            k = 2 * k + (tree[k] < key);
+        }
+        // drop the right turns taken after the last left one, k is then the
+        // smallest key not below the searched one (0 when there is none)
+        k >>= __builtin_ffsl(~k);
+        return k != 0 && tree[k] == key;
+    }
+
+    bool fingerprint_set::save(const std::string& filename, unsigned long source_size, long source_mtime) const {
+        file_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.n_key = n_key;
+        header.source_size = source_size;
+        header.source_mtime = source_mtime;
+
+        // written aside and renamed, a run reading it never sees half a file
+        std::string tmp_filename = filename + ".tmp";
+        std::ofstream out(tmp_filename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        out.write((const char*)&header, sizeof(header));
+        if (n_key > 0) {
+            out.write((const char*)tree.get(), (n_key + 1) * sizeof(uint64_t));
+        }
+        out.close();
+        if (!out || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+            remove(tmp_filename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool fingerprint_set::load(const std::string& filename, unsigned long source_size, long source_mtime) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size < sizeof(file_header)) {
+            close(fd);
+            return false;
+        }
+        size_t length = file_stat.st_size;
+        void* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+
+        const file_header* header = (const file_header*)base;
+        size_t expected = sizeof(file_header) + ((header -> n_key > 0) ? (header -> n_key + 1) * sizeof(uint64_t) : 0);
+        if (memcmp(header -> magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header -> byte_order != BYTE_ORDER_MARK
+                || header -> source_size != source_size || header -> source_mtime != source_mtime || length != expected) {
+            munmap(base, length);
+            return false;
+        }
+        n_key = header -> n_key;
+        keys.clear();
+        tree.reset((const uint64_t*)((const char*)base + sizeof(file_header)), [base, length](const uint64_t*) {munmap(base, length);});
+        return true;
+    }
+}
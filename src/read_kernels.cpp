@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstring>
+#include <read_kernels.hpp>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+namespace read_kernels {
+    static const int BASE_CODE_OTHER = 4;
+
+    static int base_code(char base) {
+        switch (base) {
+            case 'A':
+                return 0;
+            case 'C':
+                return 1;
+            case 'G':
+                return 2;
+            case 'T':
+                return 3;
+            default:
+                return BASE_CODE_OTHER;
+        }
+    }
+
+    static size_t scan_bases_scalar(const char* bases, size_t n, int* codes) {
+        size_t n_base_N = 0;
+        for (size_t i = 0; i < n; i++) {
+            n_base_N += bases[i] == 'N';
+            codes[i] = base_code(bases[i]);
+        }
+        return n_base_N;
+    }
+
+    static void scan_qualities_scalar(const char* qualities, size_t n, int zero, int threshold, int* bins, long& sum, size_t& low_quality) {
+        for (size_t i = 0; i < n; i++) {
+            int value = qualities[i] - zero;
+            sum += qualities[i];
+            low_quality += qualities[i] < threshold;
+            bins[i] = (value >= 0) ? value : 0;
+        }
+    }
+
+    static void add_clamp_scalar(char* s, size_t n, int diff, int low, int high) {
+        for (size_t i = 0; i < n; i++) {
+            int value = s[i] + diff;
+            s[i] = (value < low) ? low : ((value > high) ? high : value);
+        }
+    }
+
+    static void add_counts_scalar(unsigned long* dst, const unsigned long* src, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] += src[i];
+        }
+    }
+
+    static void min_max_scalar(const char* s, size_t n, unsigned char& min, unsigned char& max) {
+        for (size_t i = 0; i < n; i++) {
+            min = std::min(min, (unsigned char)s[i]);
+            max = std::max(max, (unsigned char)s[i]);
+        }
+    }
+
+    // the limit is checked every 16 bytes, as often as the SSE4.2 loop does
+    static size_t count_mismatches_scalar(const char* a, const char* b, size_t n, size_t limit) {
+        size_t n_mismatch = 0;
+        for (size_t i = 0; i < n && n_mismatch <= limit; i += 16) {
+            size_t end = std::min(i + 16, n);
+            for (size_t j = i; j < end; j++) {
+                n_mismatch += a[j] != b[j];
+            }
+        }
+        return n_mismatch;
+    }
+
+#ifdef HAVE_X86_KERNELS
+    // The four letters ACGT (and N) have distinct low nibbles, so one byte
+    // shuffle looks up the letter a nibble stands for and another its code.
+    // A byte only gets that code when it equals the looked up letter.
+    static const char nibble_letters[16] = {0, 'A', 0, 'C', 'T', 0, 0, 'G', 0, 0, 0, 0, 0, 0, 'N', 0};
+    static const char nibble_codes[16] = {4, 0, 4, 1, 3, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4};
+
+    // below a threshold char for signed chars: nothing below -128, everything below 128
+    static bool clamp_threshold(int threshold, size_t n, size_t& low_quality) {
+        if (threshold <= -128) {
+            return true;
+        }
+        if (threshold > 127) {
+            low_quality += n;
+            return true;
+        }
+        return false;
+    }
+
+    // 16 byte steps, inlined into both the SSE4.2 loops and the tails of
+    // the AVX2 loops where they are VEX encoded like the surrounding code
+    __attribute__((target("sse4.2,popcnt"), always_inline))
+    static inline void store_codes_16(__m128i v, int* out) {
+        _mm_storeu_si128((__m128i*)out, _mm_cvtepu8_epi32(v));
+        _mm_storeu_si128((__m128i*)(out + 4), _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+        _mm_storeu_si128((__m128i*)(out + 8), _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+        _mm_storeu_si128((__m128i*)(out + 12), _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+    }
+
+    __attribute__((target("sse4.2,popcnt"), always_inline))
+    static inline size_t scan_bases_16(const char* bases, int* codes) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)bases);
+        const __m128i nibble = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+        const __m128i is_letter = _mm_cmpeq_epi8(v, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)nibble_letters), nibble));
+        const __m128i code = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)nibble_codes), nibble);
+        store_codes_16(_mm_blendv_epi8(_mm_set1_epi8(BASE_CODE_OTHER), code, is_letter), codes);
+        return __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('N'))));
+    }
+
+    // SAD adds bytes as unsigned, chars above 127 are negative in the scalar
+    // code and are taken off again through n_negative
+    __attribute__((target("sse4.2,popcnt"), always_inline))
+    static inline void scan_qualities_16(const char* qualities, __m128i zero_quality, __m128i below, bool is_clamped, int* bins, __m128i& byte_sum, size_t& n_negative, size_t& low_quality) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)qualities);
+        const __m128i is_negative = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+        n_negative += __builtin_popcount(_mm_movemask_epi8(is_negative));
+        byte_sum = _mm_add_epi64(byte_sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+        if (!is_clamped) {
+            low_quality += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(below, v)));
+        }
+        store_codes_16(_mm_andnot_si128(is_negative, _mm_subs_epu8(v, zero_quality)), bins);
+    }
+
+    __attribute__((target("sse4.2,popcnt"), always_inline))
+    static inline void finish_qualities_16(const char* qualities, size_t n, int zero, int threshold, bool is_clamped, int* bins, __m128i byte_sum, size_t n_negative, long& sum, size_t& low_quality) {
+        sum += (long)_mm_cvtsi128_si64(byte_sum) + (long)_mm_extract_epi64(byte_sum, 1) - 256 * (long)n_negative;
+        size_t tail_low_quality = 0;
+        scan_qualities_scalar(qualities, n, zero, threshold, bins, sum, tail_low_quality);
+        if (!is_clamped) {
+            low_quality += tail_low_quality;
+        }
+    }
+
+    __attribute__((target("sse4.2,popcnt")))
+    static size_t scan_bases_sse(const char* bases, size_t n, int* codes) {
+        size_t n_base_N = 0;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            n_base_N += scan_bases_16(bases + i, codes + i);
+        }
+        return n_base_N + scan_bases_scalar(bases + i, n - i, codes + i);
+    }
+
+    __attribute__((target("sse4.2,popcnt")))
+    static void scan_qualities_sse(const char* qualities, size_t n, int zero, int threshold, int* bins, long& sum, size_t& low_quality) {
+        bool is_clamped = clamp_threshold(threshold, n, low_quality);
+        const __m128i zero_quality = _mm_set1_epi8((char)zero);
+        const __m128i below = _mm_set1_epi8(is_clamped ? 0 : (char)threshold);
+        __m128i byte_sum = _mm_setzero_si128();
+        size_t n_negative = 0;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            scan_qualities_16(qualities + i, zero_quality, below, is_clamped, bins + i, byte_sum, n_negative, low_quality);
+        }
+        finish_qualities_16(qualities + i, n - i, zero, threshold, is_clamped, bins + i, byte_sum, n_negative, sum, low_quality);
+    }
+
+    __attribute__((target("sse4.2,popcnt")))
+    static void add_clamp_sse(char* s, size_t n, int diff, int low, int high) {
+        const __m128i add = _mm_set1_epi8((char)diff);
+        const __m128i lowest = _mm_set1_epi8((char)low);
+        const __m128i highest = _mm_set1_epi8((char)high);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_adds_epi8(_mm_loadu_si128((const __m128i*)(s + i)), add);
+            _mm_storeu_si128((__m128i*)(s + i), _mm_min_epi8(_mm_max_epi8(v, lowest), highest));
+        }
+        add_clamp_scalar(s + i, n - i, diff, low, high);
+    }
+
+    __attribute__((target("sse4.2,popcnt")))
+    static void add_counts_sse(unsigned long* dst, const unsigned long* src, size_t n) {
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            _mm_store_si128((__m128i*)(dst + i), _mm_add_epi64(_mm_load_si128((const __m128i*)(dst + i)), _mm_load_si128((const __m128i*)(src + i))));
+        }
+        add_counts_scalar(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("sse4.2,popcnt")))
+    static void min_max_sse(const char* s, size_t n, unsigned char& min, unsigned char& max) {
+        if (n < 16) {
+            min_max_scalar(s, n, min, max);
+            return;
+        }
+        __m128i lowest = _mm_set1_epi8((char)min);
+        __m128i highest = _mm_set1_epi8((char)max);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            lowest = _mm_min_epu8(lowest, v);
+            highest = _mm_max_epu8(highest, v);
+        }
+        // the last 16 bytes once more cover the tail
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + n - 16));
+        lowest = _mm_min_epu8(lowest, v);
+        highest = _mm_max_epu8(highest, v);
+        unsigned char bytes[16];
+        _mm_storeu_si128((__m128i*)bytes, lowest);
+        min = *std::min_element(bytes, bytes + 16);
+        _mm_storeu_si128((__m128i*)bytes, highest);
+        max = *std::max_element(bytes, bytes + 16);
+    }
+
+    // the limit is checked once per vector, the scalar tail is short
+    __attribute__((target("sse4.2,popcnt")))
+    static size_t count_mismatches_sse(const char* a, const char* b, size_t n, size_t limit) {
+        size_t n_mismatch = 0;
+        size_t i = 0;
+        for (; i + 16 <= n && n_mismatch <= limit; i += 16) {
+            __m128i is_equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+            n_mismatch += 16 - __builtin_popcount(_mm_movemask_epi8(is_equal));
+        }
+        if (n_mismatch > limit) {
+            return n_mismatch;
+        }
+        return n_mismatch + count_mismatches_scalar(a + i, b + i, n - i, limit - n_mismatch);
+    }
+
+    __attribute__((target("avx2,popcnt"), always_inline))
+    static inline void store_codes_32(__m256i v, int* out) {
+        __m128i low = _mm256_castsi256_si128(v);
+        __m128i high = _mm256_extracti128_si256(v, 1);
+        _mm256_storeu_si256((__m256i*)out, _mm256_cvtepu8_epi32(low));
+        _mm256_storeu_si256((__m256i*)(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+        _mm256_storeu_si256((__m256i*)(out + 16), _mm256_cvtepu8_epi32(high));
+        _mm256_storeu_si256((__m256i*)(out + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static size_t scan_bases_avx2(const char* bases, size_t n, int* codes) {
+        const __m256i letters = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_letters));
+        const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_codes));
+        const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+        const __m256i other = _mm256_set1_epi8(BASE_CODE_OTHER);
+        const __m256i base_N = _mm256_set1_epi8('N');
+        size_t n_base_N = 0;
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(bases + i));
+            __m256i nibble = _mm256_and_si256(v, low_nibble);
+            __m256i is_letter = _mm256_cmpeq_epi8(v, _mm256_shuffle_epi8(letters, nibble));
+            __m256i code = _mm256_blendv_epi8(other, _mm256_shuffle_epi8(table, nibble), is_letter);
+            n_base_N += __builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, base_N)));
+            store_codes_32(code, codes + i);
+        }
+        if (i + 16 <= n) {
+            n_base_N += scan_bases_16(bases + i, codes + i);
+            i += 16;
+        }
+        return n_base_N + scan_bases_scalar(bases + i, n - i, codes + i);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static void scan_qualities_avx2(const char* qualities, size_t n, int zero, int threshold, int* bins, long& sum, size_t& low_quality) {
+        bool is_clamped = clamp_threshold(threshold, n, low_quality);
+        const __m256i zero_quality = _mm256_set1_epi8((char)zero);
+        const __m256i nothing = _mm256_setzero_si256();
+        const __m256i below = _mm256_set1_epi8(is_clamped ? 0 : (char)threshold);
+        __m256i byte_sum = _mm256_setzero_si256();
+        size_t n_negative = 0;
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(qualities + i));
+            __m256i is_negative = _mm256_cmpgt_epi8(nothing, v);
+            n_negative += __builtin_popcount((unsigned int)_mm256_movemask_epi8(is_negative));
+            byte_sum = _mm256_add_epi64(byte_sum, _mm256_sad_epu8(v, nothing));
+            if (!is_clamped) {
+                low_quality += __builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(below, v)));
+            }
+            store_codes_32(_mm256_andnot_si256(is_negative, _mm256_subs_epu8(v, zero_quality)), bins + i);
+        }
+        __m128i half_sum = _mm_add_epi64(_mm256_castsi256_si128(byte_sum), _mm256_extracti128_si256(byte_sum, 1));
+        if (i + 16 <= n) {
+            scan_qualities_16(qualities + i, _mm256_castsi256_si128(zero_quality), _mm256_castsi256_si128(below), is_clamped, bins + i, half_sum, n_negative, low_quality);
+            i += 16;
+        }
+        finish_qualities_16(qualities + i, n - i, zero, threshold, is_clamped, bins + i, half_sum, n_negative, sum, low_quality);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static void add_clamp_avx2(char* s, size_t n, int diff, int low, int high) {
+        const __m256i add = _mm256_set1_epi8((char)diff);
+        const __m256i lowest = _mm256_set1_epi8((char)low);
+        const __m256i highest = _mm256_set1_epi8((char)high);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), add);
+            _mm256_storeu_si256((__m256i*)(s + i), _mm256_min_epi8(_mm256_max_epi8(v, lowest), highest));
+        }
+        add_clamp_scalar(s + i, n - i, diff, low, high);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static void add_counts_avx2(unsigned long* dst, const unsigned long* src, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm256_store_si256((__m256i*)(dst + i), _mm256_add_epi64(_mm256_load_si256((const __m256i*)(dst + i)), _mm256_load_si256((const __m256i*)(src + i))));
+        }
+        add_counts_scalar(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static void min_max_avx2(const char* s, size_t n, unsigned char& min, unsigned char& max) {
+        if (n < 32) {
+            min_max_sse(s, n, min, max);
+            return;
+        }
+        __m256i lowest = _mm256_set1_epi8((char)min);
+        __m256i highest = _mm256_set1_epi8((char)max);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+            lowest = _mm256_min_epu8(lowest, v);
+            highest = _mm256_max_epu8(highest, v);
+        }
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+        lowest = _mm256_min_epu8(lowest, v);
+        highest = _mm256_max_epu8(highest, v);
+        unsigned char bytes[32];
+        _mm256_storeu_si256((__m256i*)bytes, lowest);
+        min = *std::min_element(bytes, bytes + 32);
+        _mm256_storeu_si256((__m256i*)bytes, highest);
+        max = *std::max_element(bytes, bytes + 32);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    static size_t count_mismatches_avx2(const char* a, const char* b, size_t n, size_t limit) {
+        size_t n_mismatch = 0;
+        size_t i = 0;
+        for (; i + 32 <= n && n_mismatch <= limit; i += 32) {
+            __m256i is_equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+            n_mismatch += 32 - __builtin_popcount((unsigned int)_mm256_movemask_epi8(is_equal));
+        }
+        if (n_mismatch > limit) {
+            return n_mismatch;
+        }
+        if (i + 16 <= n) {
+            __m128i is_equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+            n_mismatch += 16 - __builtin_popcount(_mm_movemask_epi8(is_equal));
+            i += 16;
+        }
+        if (n_mismatch > limit) {
+            return n_mismatch;
+        }
+        return n_mismatch + count_mismatches_scalar(a + i, b + i, n - i, limit - n_mismatch);
+    }
+#endif
+
+    struct kernel_set {
+        const char* name;
+        size_t (*scan_bases)(const char*, size_t, int*);
+        void (*scan_qualities)(const char*, size_t, int, int, int*, long&, size_t&);
+        void (*add_clamp)(char*, size_t, int, int, int);
+        void (*add_counts)(unsigned long*, const unsigned long*, size_t);
+        size_t (*count_mismatches)(const char*, const char*, size_t, size_t);
+        void (*min_max)(const char*, size_t, unsigned char&, unsigned char&);
+    };
+
+    // the best version the CPU supports, not going past SSE4.2 or scalar
+    // when those are asked for
+    static kernel_set choose_kernels(bool allow_avx2 = true, bool allow_sse = true) {
+        kernel_set kernels = {"scalar", scan_bases_scalar, scan_qualities_scalar, add_clamp_scalar, add_counts_scalar, count_mismatches_scalar, min_max_scalar};
+#ifdef HAVE_X86_KERNELS
+        __builtin_cpu_init();
+        if (allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            kernels.name = "AVX2";
+            kernels.scan_bases = scan_bases_avx2;
+            kernels.scan_qualities = scan_qualities_avx2;
+            kernels.add_clamp = add_clamp_avx2;
+            kernels.add_counts = add_counts_avx2;
+            kernels.count_mismatches = count_mismatches_avx2;
+            kernels.min_max = min_max_avx2;
+        }
+        else if (allow_sse && __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+            kernels.name = "SSE4.2";
+            kernels.scan_bases = scan_bases_sse;
+            kernels.scan_qualities = scan_qualities_sse;
+            kernels.add_clamp = add_clamp_sse;
+            kernels.add_counts = add_counts_sse;
+            kernels.count_mismatches = count_mismatches_sse;
+            kernels.min_max = min_max_sse;
+        }
+#endif
+        return kernels;
+    }
+
+    static kernel_set kernels = choose_kernels();
+
+    bool use_kernels(const char* name) {
+        bool is_avx2 = strcmp(name, "AVX2") == 0;
+        kernel_set chosen = choose_kernels(is_avx2, is_avx2 || strcmp(name, "SSE4.2") == 0);
+        if (strcmp(chosen.name, name) != 0) {
+            return false;
+        }
+        kernels = chosen;
+        return true;
+    }
+
+    size_t scan_bases(const char* bases, size_t n, int* codes) {
+        return kernels.scan_bases(bases, n, codes);
+    }
+
+    void scan_qualities(const char* qualities, size_t n, int zero, int threshold, int* bins, long& sum, size_t& low_quality) {
+        kernels.scan_qualities(qualities, n, zero, threshold, bins, sum, low_quality);
+    }
+
+    void add_clamp(char* s, size_t n, int diff, int low, int high) {
+        kernels.add_clamp(s, n, diff, low, high);
+    }
+
+    void add_counts(unsigned long* dst, const unsigned long* src, size_t n) {
+        kernels.add_counts(dst, src, n);
+    }
+
+    size_t count_mismatches(const char* a, const char* b, size_t n, size_t limit) {
+        return kernels.count_mismatches(a, b, n, limit);
+    }
+
+    void min_max(const char* s, size_t n, unsigned char& min, unsigned char& max) {
+        kernels.min_max(s, n, min, max);
+    }
+
+    const char* kernel_name() {return kernels.name;}
+}
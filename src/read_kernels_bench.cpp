@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <read_kernels.hpp>
+
+// Runs the AVX2, SSE4.2 and scalar read kernels on the same random reads
+// and prints the time each takes, with a checksum of the results that has
+// to be the same for all of them.
+//
+//   read_kernels_bench [n_read] [read_len]
+
+const int N_ROUND = 5;
+const char* KERNEL_NAMES[3] = {"AVX2", "SSE4.2", "scalar"};
+
+struct bench_input {
+    std::string bases;
+    std::string qualities;
+    std::string mates;      // the bases with a few mismatches, for count_mismatches
+    size_t n_read;
+    size_t read_len;
+};
+
+static bench_input make_input(size_t n_read, size_t read_len) {
+    bench_input input;
+    input.n_read = n_read;
+    input.read_len = read_len;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> base(0, 99);
+    std::uniform_int_distribution<int> quality('#', 'J');
+    const char* letters = "ACGT";
+    for (size_t i = 0; i < n_read * read_len; i++) {
+        int b = base(random);
+        input.bases.push_back((b == 0) ? 'N' : letters[b % 4]);
+        input.qualities.push_back(quality(random));
+        input.mates.push_back((b < 3) ? letters[(b + 1) % 4] : input.bases.back());
+    }
+    return input;
+}
+
+template <typename F>
+static double time_rounds(F run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int round = 0; round < N_ROUND; round++) {
+        run();
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+    return dt.count() / N_ROUND;
+}
+
+static void run_kernels(const bench_input& input) {
+    std::vector<int> out(input.read_len);
+    std::string converted = input.qualities;
+    unsigned long checksum = 0;
+    const size_t limit = input.read_len / 10;
+
+    double t_bases = time_rounds([&]() {
+        for (size_t r = 0; r < input.n_read; r++) {
+            checksum += read_kernels::scan_bases(input.bases.data() + r * input.read_len, input.read_len, out.data());
+        }
+    });
+    double t_qualities = time_rounds([&]() {
+        for (size_t r = 0; r < input.n_read; r++) {
+            long sum = 0;
+            size_t low_quality = 0;
+            read_kernels::scan_qualities(input.qualities.data() + r * input.read_len, input.read_len, 33, 38, out.data(), sum, low_quality);
+            checksum += sum + low_quality;
+        }
+    });
+    double t_mismatches = time_rounds([&]() {
+        for (size_t r = 0; r < input.n_read; r++) {
+            // past the limit only whether it was exceeded is the same everywhere
+            size_t n_mismatch = read_kernels::count_mismatches(input.bases.data() + r * input.read_len, input.mates.data() + r * input.read_len, input.read_len, limit);
+            checksum += (n_mismatch > limit) ? limit + 1 : n_mismatch;
+        }
+    });
+    double t_min_max = time_rounds([&]() {
+        for (size_t r = 0; r < input.n_read; r++) {
+            unsigned char min = '~';
+            unsigned char max = '!';
+            read_kernels::min_max(input.qualities.data() + r * input.read_len, input.read_len, min, max);
+            checksum += min + max;
+        }
+    });
+    double t_clamp = time_rounds([&]() {
+        converted = input.qualities;
+        for (size_t r = 0; r < input.n_read; r++) {
+            read_kernels::add_clamp(&converted[r * input.read_len], input.read_len, 31, 64, 104);
+        }
+    });
+    for (size_t i = 0; i < converted.size(); i++) {
+        checksum += (unsigned char)converted[i];
+    }
+
+    double mbases = input.n_read * input.read_len / 1e6;
+    std::cout << std::setw(8) << std::left << read_kernels::kernel_name() << std::right << std::fixed << std::setprecision(0)
+        << std::setw(14) << mbases / t_bases
+        << std::setw(14) << mbases / t_qualities
+        << std::setw(14) << mbases / t_mismatches
+        << std::setw(14) << mbases / t_min_max
+        << std::setw(14) << mbases / t_clamp
+        << "    " << checksum << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n_read = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 200000;
+    size_t read_len = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 150;
+    if (n_read == 0 || read_len == 0) {
+        std::cerr << "usage: read_kernels_bench [n_read] [read_len]" << std::endl;
+        return 1;
+    }
+    bench_input input = make_input(n_read, read_len);
+
+    std::cout << n_read << " reads of " << read_len << " bases, Mbases/s averaged over " << N_ROUND << " rounds" << std::endl;
+    std::cout << std::setw(8) << std::left << "kernel" << std::right
+        << std::setw(14) << "scan_bases"
+        << std::setw(14) << "scan_quals"
+        << std::setw(14) << "mismatches"
+        << std::setw(14) << "min_max"
+        << std::setw(14) << "add_clamp"
+        << "    checksum" << std::endl;
+    for (int k = 0; k < 3; k++) {
+        if (!read_kernels::use_kernels(KERNEL_NAMES[k])) {
+            std::cout << std::setw(8) << std::left << KERNEL_NAMES[k] << "not supported by this CPU" << std::endl;
+            continue;
+        }
+        run_kernels(input);
+    }
+    return 0;
+}